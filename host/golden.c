@@ -0,0 +1,435 @@
+// ---------------------------------------------------------------------------
+// golden.c
+//
+// Golden-image check of the render modes, so a speedup that costs image
+// quality shows how much it costs. Every case renders through the same
+// code as the 6502, into XRAM held in memory, and is compared with a
+// reference image in host/golden/ against its own error budget: a lowest
+// PSNR and a largest difference in any 8-bit channel. The CPU time of each
+// render is reported next to its error.
+//
+//   golden                   compare, exit 1 if anything is over budget
+//   golden -o out            also write what was rendered to out/
+//   golden -l results.csv    append the results, for tracking over time
+//   golden -u                render the references again
+//
+// Tracer cases: each render mode from each of a few camera views, compared
+// with a reference from that view traced exactly, pixel by pixel in row
+// order: at pixel corners for render_scene and the interleaved passes, as
+// they trace, and at pixel centers of each render scale for the progressive
+// passes. The budgets are how far each mode is allowed to drift from its
+// reference, and the exact traces from theirs. The frame-time governor runs
+// the progressive passes for as long as the wall clock allows, so it has no
+// case of its own.
+//
+// Canvas cases: the raytracer only draws at 16bpp, so the other color
+// depths of init_bitmap_graphics get a fixed picture of the graphics
+// primitives instead, which has to match its reference exactly.
+// ---------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L // getopt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <rp6502.h>
+#include "bitmap_graphics.h"
+#include "colors.h"
+#include "xram_map.h"
+#include "ppm.h"
+#include "raytracer_host.h"
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "golden"
+#endif
+
+#define CANVAS_STRUCT 0xFF00
+#define PICTURE_WIDTH 160 // of the canvas compared in the canvas cases
+#define PICTURE_HEIGHT 120
+#define PI 3.14159265f
+
+typedef struct {
+    float minPsnr;    // dB
+    uint8_t maxError; // largest difference in one 8-bit channel
+} Budget;
+
+typedef struct {
+    const char *name;
+    float x, y, z;   // camera position
+    float yaw;       // degrees, around y
+    float pitch;     // degrees, up from level
+} View;
+
+typedef struct {
+    const char *name;
+    uint8_t scale;   // render scale
+    uint8_t passes;  // 0: render_scene, 1: progressive, else interleaved
+    Budget budget;
+} TracerMode;
+
+static const View views[] = {
+    {"front", 0.0f, 0.0f, -0.5f, 0.0f, 0.0f},
+    {"side", 1.4f, 0.4f, -1.0f, -22.0f, -8.0f},
+    {"high", -0.4f, 0.9f, -0.3f, 8.0f, -25.0f},
+    {"below", 0.0f, -0.6f, 0.0f, 0.0f, 10.0f},  // inside the ground sphere
+    {"inside", 0.8f, 0.5f, 2.2f, 30.0f, 0.0f},  // inside the green sphere
+};
+#define VIEW_COUNT (int)(sizeof(views) / sizeof(View))
+
+// The exact trace itself: a one-step rounding flip in a few pixels, from a
+// different compiler, and no more. Math that trades accuracy on purpose
+// (fixed point, sqrt tables) comes with new references.
+static const Budget exactBudget = {45.0f, 9};
+
+// render_scene and the interleaved passes trace the same rays with the
+// scanline solve and must stay within a few pixels of the exact trace; the
+// largest errors there are shading flips where a light over the shadow ray
+// budget reuses another pixel's shadow, and reflection edges that move
+// with the rounding of the hit distance. The progressive passes end with
+// every pixel traced on its own through trace_pixel(), so they are held to
+// the exact budget. Other budgets sit about 1 dB and one 5-bit step outside
+// the worst view when the references were made.
+static const TracerMode tracerModes[] = {
+    {"scene", 1, 0, {48.5f, 132}},
+    {"progressive", 1, 1, {45.0f, 9}},
+    {"progressive-x2", 2, 1, {45.0f, 9}},
+    {"progressive-x4", 4, 1, {45.0f, 9}},
+    {"interleaved-4", 1, 4, {51.5f, 132}},
+    {"interleaved-2", 1, 2, {51.5f, 132}},
+};
+#define TRACER_MODE_COUNT (int)(sizeof(tracerModes) / sizeof(TracerMode))
+
+static const uint8_t canvasBpps[] = {16, 8, 4, 2, 1};
+#define CANVAS_BPP_COUNT (int)sizeof(canvasBpps)
+
+static const char *goldenDir = GOLDEN_DIR;
+static const char *outDir = NULL;
+static FILE *csv = NULL;
+static char runTime[32];
+static bool update = false;
+static int failures = 0;
+
+// ---------------------------------------------------------------------------
+// Fresh XRAM and a canvas with its config struct at CANVAS_STRUCT
+// ---------------------------------------------------------------------------
+static void init_canvas(uint16_t width, uint16_t height, uint8_t bpp)
+{
+    memset(ria_host.xram, 0, sizeof(ria_host.xram));
+    xram_reset();
+    init_bitmap_graphics(CANVAS_STRUCT, XRAM_NULL, 0, 2, width, height, bpp);
+}
+
+// ---------------------------------------------------------------------------
+// w x h pixels at (x0, y0) of the canvas as the VGA would show them, read
+// through the config struct. Indexed colors go through the 16 colors of
+// colors.c; only those are drawn.
+// ---------------------------------------------------------------------------
+static void read_canvas(int x0, int y0, int w, int h, uint8_t *rgb)
+{
+    const uint8_t *config = &ria_host.xram[CANVAS_STRUCT];
+    uint16_t width = config[offsetof(vga_mode3_config_t, width_px)] |
+                     config[offsetof(vga_mode3_config_t, width_px) + 1] << 8;
+    uint16_t data = config[offsetof(vga_mode3_config_t, xram_data_ptr)] |
+                    config[offsetof(vga_mode3_config_t, xram_data_ptr) + 1] << 8;
+    uint8_t bpp = bits_per_pixel();
+
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t bit = ((uint32_t)(y0 + y) * width + x0 + x) * bpp;
+            const uint8_t *p = &ria_host.xram[(uint16_t)(data + (bit >> 3))];
+            uint16_t pixel;
+            if (bpp == 16) {
+                pixel = p[0] | p[1] << 8;
+            } else if (bpp == 8) {
+                pixel = color(p[0] & 15, true);
+            } else {
+                uint8_t shift = 8 - bpp - (bit & 7); // leftmost pixel in the high bits
+                pixel = color((p[0] >> shift) & ((1 << bpp) - 1), true);
+            }
+            rgb555_to_rgb8(pixel, &rgb[(y * w + x) * 3]);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Compare with the reference, or replace it, and report
+// ---------------------------------------------------------------------------
+static void check(const char *name, const char *reference, const uint8_t *rgb,
+                  int w, int h, double ms, const Budget *budget)
+{
+    char path[1024];
+
+    if (outDir) {
+        snprintf(path, sizeof(path), "%s/%s.ppm", outDir, name);
+        if (!write_ppm(path, rgb, w, h)) {
+            fprintf(stderr, "can't write %s\n", path);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", goldenDir, reference);
+    if (update) {
+        if (write_ppm(path, rgb, w, h)) {
+            printf("%-26s %9.2f  wrote %s\n", name, ms, path);
+        } else {
+            fprintf(stderr, "can't write %s\n", path);
+            failures++;
+        }
+        return;
+    }
+
+    int refW, refH;
+    uint8_t *ref = read_ppm(path, &refW, &refH);
+    if (!ref || refW != w || refH != h) {
+        printf("%-26s %9.2f  no %dx%d reference %s\n", name, ms, w, h, path);
+        free(ref);
+        failures++;
+        return;
+    }
+
+    double sum = 0.0;
+    int maxError = 0;
+    for (long i = 0; i < (long)w * h * 3; i++) {
+        int e = abs(rgb[i] - ref[i]);
+        sum += e * e;
+        if (e > maxError) maxError = e;
+    }
+    free(ref);
+    double mse = sum / ((double)w * h * 3);
+    double psnr = (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+    bool pass = psnr >= budget->minPsnr && maxError <= budget->maxError;
+    if (!pass) failures++;
+
+    printf("%-26s %9.2f %8.2f %5d   >= %4.1f, <= %3u  %s\n", name, ms, psnr, maxError,
+           budget->minPsnr, budget->maxError, pass ? "ok" : "OVER BUDGET");
+    if (csv) {
+        fprintf(csv, "%s,%s,%.3f,%.3f,%d,%.1f,%u,%s\n", runTime, name, ms, psnr, maxError,
+                budget->minPsnr, budget->maxError, pass ? "ok" : "over");
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static double ms_since(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// ---------------------------------------------------------------------------
+// The exact trace the progressive passes converge to: every pixel of the
+// traced grid at this render scale traced at its center, as the passes'
+// single-pixel blocks are, then doubled up to window pixels as put_block()
+// does
+// ---------------------------------------------------------------------------
+static void trace_centers(uint8_t scale, uint8_t *rgb, int w, int h)
+{
+    memset(rgb, 0, (size_t)w * h * 3); // as erased, where the grid doesn't reach
+    set_render_scale(scale);
+    update_row_spans();
+    reset_shadow_cache();
+    for (int y = 0; y < h / scale; y++) {
+        for (int x = 0; x < w / scale; x++) {
+            uint8_t pixel[3];
+            rgb555_to_rgb8(trace_pixel(x + 0.5f, y + 0.5f), pixel);
+            for (int i = 0; i < scale * scale; i++) {
+                memcpy(&rgb[((y * scale + i / scale) * w + x * scale + i % scale) * 3], pixel, 3);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Every tracer mode from one view, against the exact trace from that view
+// ---------------------------------------------------------------------------
+static void check_view(const View *view)
+{
+    float yaw = view->yaw * PI / 180.0f;
+    float pitch = view->pitch * PI / 180.0f;
+    int w = windowWidth;
+    int h = windowHeight;
+    uint8_t *rgb = malloc((size_t)w * h * 3);
+    char name[128];
+    char reference[128];
+
+    set_camera(view->x, view->y, view->z, cosf(yaw), sinf(yaw), cosf(pitch), sinf(pitch));
+    snprintf(reference, sizeof(reference), "view-%s", view->name);
+
+    // The reference: every pixel traced exactly, in row order
+    set_render_scale(1);
+    update_shadow_casters();
+    update_row_spans(); // or the last view's would cull this one's rays
+    reset_shadow_cache();
+    clock_t start = clock();
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            rgb555_to_rgb8(trace_pixel(x, y), &rgb[(y * w + x) * 3]);
+        }
+    }
+    snprintf(name, sizeof(name), "%s-exact", view->name);
+    check(name, reference, rgb, w, h, ms_since(start), &exactBudget);
+
+    // The progressive passes' references, sampled at pixel centers
+    for (int m = 0; m < TRACER_MODE_COUNT; m++) {
+        const TracerMode *mode = &tracerModes[m];
+        if (mode->passes == 1) {
+            start = clock();
+            trace_centers(mode->scale, rgb, w, h);
+            snprintf(name, sizeof(name), "%s-center-x%u", view->name, mode->scale);
+            snprintf(reference, sizeof(reference), "view-%s-center-x%u", view->name, mode->scale);
+            check(name, reference, rgb, w, h, ms_since(start), &exactBudget);
+        }
+    }
+
+    if (update) {
+        free(rgb);
+        return;
+    }
+    for (int m = 0; m < TRACER_MODE_COUNT; m++) {
+        const TracerMode *mode = &tracerModes[m];
+        if (mode->passes == 1) {
+            snprintf(reference, sizeof(reference), "view-%s-center-x%u", view->name, mode->scale);
+        } else {
+            snprintf(reference, sizeof(reference), "view-%s", view->name);
+        }
+        erase_canvas();
+        set_render_scale(mode->scale);
+        reset_shadow_cache();
+        start = clock();
+        if (mode->passes == 0) {
+            render_scene();
+        } else if (mode->passes == 1) {
+            render_scene_progressive();
+        } else {
+            render_scene_interleaved(mode->passes);
+        }
+        double ms = ms_since(start);
+        read_canvas(0, 0, w, h, rgb);
+        snprintf(name, sizeof(name), "%s-%s", view->name, mode->name);
+        check(name, reference, rgb, w, h, ms, &mode->budget);
+    }
+    free(rgb);
+}
+
+// ---------------------------------------------------------------------------
+// A fixed picture of the graphics primitives in the top left of the canvas
+// ---------------------------------------------------------------------------
+static void draw_picture(bool bpp16)
+{
+    clear_canvas(color(BLACK, bpp16));
+    for (int i = 0; i < 16; i++) {
+        uint16_t c = color(i, bpp16);
+        fill_rect(c, 2 + i * 5, 2, 4, 10);
+        draw_line(c, 80, 60, 80 + (i - 8) * 10, 14);
+        draw_line(c, 80, 60, 158, 20 + i * 6);
+    }
+    draw_rect(color(WHITE, bpp16), 0, 0, PICTURE_WIDTH, PICTURE_HEIGHT);
+    draw_circle(color(YELLOW, bpp16), 30, 50, 20);
+    fill_circle(color(RED, bpp16), 30, 50, 12);
+    draw_rounded_rect(color(CYAN, bpp16), 6, 76, 60, 30, 8);
+    fill_rounded_rect(color(DARK_BLUE, bpp16), 10, 80, 52, 22, 6);
+    draw_vline(color(GREEN, bpp16), 70, 64, 50);
+    draw_hline(color(MAGENTA, bpp16), 72, 112, 80);
+    set_text_wrap(false);
+    set_text_colors(color(WHITE, bpp16), color(DARK_GRAY, bpp16));
+    set_cursor(76, 92);
+    draw_string("RP6502 bpp");
+    set_text_multiplier(2);
+    set_text_color(color(BROWN, bpp16));
+    set_cursor(16, 84);
+    draw_string("ok");
+    set_text_multiplier(1);
+}
+
+// ---------------------------------------------------------------------------
+// The picture at one color depth, which has to match exactly
+// ---------------------------------------------------------------------------
+static void check_canvas(uint8_t bpp)
+{
+    uint8_t *rgb = malloc(PICTURE_WIDTH * PICTURE_HEIGHT * 3);
+    char name[64];
+    Budget exact = {INFINITY, 0};
+
+    // The largest canvas init_bitmap_graphics allows in 320x180 mode
+    if (bpp >= 8) {
+        init_canvas(240, 124, bpp);
+    } else {
+        init_canvas(320, 180, bpp);
+    }
+    clock_t start = clock();
+    draw_picture(bpp == 16);
+    double ms = ms_since(start);
+    read_canvas(0, 0, PICTURE_WIDTH, PICTURE_HEIGHT, rgb);
+    snprintf(name, sizeof(name), "canvas-%ubpp", bpp);
+    check(name, name, rgb, PICTURE_WIDTH, PICTURE_HEIGHT, ms, &exact);
+    free(rgb);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-u] [-d golden_dir] [-o out_dir] [-l results.csv]\n"
+            "  -u  write the references instead of comparing\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ud:o:l:")) != -1) {
+        switch (opt) {
+        case 'u': update = true; break;
+        case 'd': goldenDir = optarg; break;
+        case 'o': outDir = optarg; break;
+        case 'l':
+            csv = fopen(optarg, "a");
+            if (!csv) {
+                fprintf(stderr, "%s: can't open %s\n", argv[0], optarg);
+                return 2;
+            }
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+    }
+    time_t now = time(NULL);
+    strftime(runTime, sizeof(runTime), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    if (csv) {
+        fseek(csv, 0, SEEK_END);
+        if (ftell(csv) == 0) {
+            fprintf(csv, "run,case,cpu_ms,psnr_db,max_error,min_psnr_db,max_error_budget,result\n");
+        }
+    }
+
+    printf("%-26s %9s %8s %5s   %-15s\n", "case", "cpu ms", "PSNR dB", "max", "budget");
+    for (int i = 0; i < CANVAS_BPP_COUNT; i++) {
+        check_canvas(canvasBpps[i]);
+    }
+
+    // The 6502's setup, see main() in raytracer_float.c
+    init_canvas(240, 124, 16);
+    erase_canvas();
+    init_shade_lut();
+    init_render_window();
+    init_gbuffer();
+    for (int i = 0; i < VIEW_COUNT; i++) {
+        check_view(&views[i]);
+    }
+
+    if (csv) {
+        fclose(csv);
+    }
+    if (update) {
+        printf("%s references written to %s\n", failures ? "Not all" : "All", goldenDir);
+    } else {
+        printf("%d case(s) over budget\n", failures);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+// ---------------------------------------------------------------------------
+// hostrender.c
+//
+// Reference renderer: the tracer core of raytracer_float.c built natively,
+// rendering its scene at any resolution on every core. For golden images,
+// previews at a resolution the RP6502 can't show, and timing changes to the
+// tracer without the 6502 in the way.
+//
+// The image is cut into tiles. Each thread starts with an equal run of
+// them and, when it runs out, steals the back half of the longest run left
+// with another thread. Writes a PPM and reports primary rays per second and
+// how busy each thread was: its CPU time over the wall time of the render.
+//
+//   hostrender -w 1920 -h 1080 -o scene.ppm
+//
+// Pixels are traced one by one with trace_pixel() at their corners, as
+// render_scene() and golden's exact reference sample them (the progressive
+// passes sample centers), but without render_scene()'s scanline solver.
+// With more lights than shadow rays per pixel (SHADOW_RAY_BUDGET plus one
+// in turn), the rest reuse the last shadow traced for them, so images
+// follow the order pixels are traced in: each tile starts with no shadow to
+// reuse, which keeps the image the same whichever thread traces what, but
+// not the same as the 6502's.
+// ---------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime, getopt, sysconf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ppm.h"
+#include "raytracer_host.h"
+
+#define MAX_THREADS 256
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int next;        // tiles still to trace are [next, end)
+    int end;
+    int tiles;       // traced by this thread
+    int steals;
+    double cpuSecs;  // CPU time the thread got
+} Worker;
+
+static Worker workers[MAX_THREADS];
+static int workerCount;
+
+static int width = 320;
+static int height = 240;
+static int tileSize = 16;
+static int tilesX, tilesY;
+static uint16_t *pixels;
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static double clock_secs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static void trace_tile(int tile)
+{
+    int x0 = (tile % tilesX) * tileSize;
+    int y0 = (tile / tilesX) * tileSize;
+    int x1 = (x0 + tileSize < width) ? x0 + tileSize : width;
+    int y1 = (y0 + tileSize < height) ? y0 + tileSize : height;
+
+    // Tiles don't depend on which tile the thread traced before
+    reset_shadow_cache();
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            pixels[y * width + x] = trace_pixel(x, y);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Next tile off the front of a worker's own run, -1 when it is empty
+// ---------------------------------------------------------------------------
+static int take_tile(Worker *w)
+{
+    int tile = -1;
+    pthread_mutex_lock(&w->lock);
+    if (w->next < w->end) {
+        tile = w->next++;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return tile;
+}
+
+// ---------------------------------------------------------------------------
+// Tiles left in w's run, read under its lock
+// ---------------------------------------------------------------------------
+static int tiles_left(Worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    int left = w->end - w->next;
+    pthread_mutex_unlock(&w->lock);
+    return left;
+}
+
+// ---------------------------------------------------------------------------
+// Move the back half (rounded up) of the longest other run to w. Returns
+// false once every run is empty.
+// ---------------------------------------------------------------------------
+static bool steal_tiles(Worker *w)
+{
+    for (;;) {
+        Worker *victim = NULL;
+        int most = 0;
+        for (int i = 0; i < workerCount; i++) {
+            if (&workers[i] == w) {
+                continue;
+            }
+            int left = tiles_left(&workers[i]); // may change before the steal, checked below
+            if (left > most) {
+                most = left;
+                victim = &workers[i];
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+
+        pthread_mutex_lock(&victim->lock);
+        int left = victim->end - victim->next;
+        int first = victim->end - (left + 1) / 2;
+        int end = victim->end;
+        if (left > 0) {
+            victim->end = first;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (left > 0) {
+            pthread_mutex_lock(&w->lock);
+            w->next = first;
+            w->end = end;
+            w->steals++;
+            pthread_mutex_unlock(&w->lock);
+            return true;
+        }
+        // Emptied by its owner or another thief meanwhile, look again
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static void *worker_main(void *arg)
+{
+    Worker *w = arg;
+
+    do {
+        int tile;
+        while ((tile = take_tile(w)) >= 0) {
+            trace_tile(tile);
+            w->tiles++;
+        }
+    } while (steal_tiles(w));
+    w->cpuSecs = clock_secs(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-w width] [-h height] [-t threads] [-s tile] [-o file.ppm]\n"
+            "  defaults: 320x240, one thread per core, 16x16 tiles, render.ppm\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = "render.ppm";
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    workerCount = (cores > 0) ? (int)cores : 1;
+    while ((opt = getopt(argc, argv, "w:h:t:s:o:")) != -1) {
+        switch (opt) {
+        case 'w': width = atoi(optarg); break;
+        case 'h': height = atoi(optarg); break;
+        case 't': workerCount = atoi(optarg); break;
+        case 's': tileSize = atoi(optarg); break;
+        case 'o': out = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || width < 1 || height < 1 || tileSize < 1) {
+        usage(argv[0]);
+    }
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > MAX_THREADS) workerCount = MAX_THREADS;
+
+    pixels = malloc((size_t)width * height * sizeof(uint16_t));
+    uint8_t *rgb = malloc((size_t)width * height * 3);
+    if (!pixels || !rgb) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    // Everything the threads share is built up front
+    init_shade_lut();
+    set_trace_size(width, height);
+    update_shadow_casters();
+
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+    for (int i = 0; i < workerCount; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        workers[i].next = (int)((long)tileCount * i / workerCount);
+        workers[i].end = (int)((long)tileCount * (i + 1) / workerCount);
+    }
+
+    double start = clock_secs(CLOCK_MONOTONIC);
+    for (int i = 0; i < workerCount; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "%s: can't start thread %d\n", argv[0], i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < workerCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    double secs = clock_secs(CLOCK_MONOTONIC) - start;
+
+    for (long i = 0; i < (long)width * height; i++) {
+        rgb555_to_rgb8(pixels[i], &rgb[i * 3]);
+    }
+    if (!write_ppm(out, rgb, width, height)) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], out);
+        return 1;
+    }
+
+    printf("%s: %dx%d, %d tiles of %dx%d, %d threads\n",
+           out, width, height, tileCount, tileSize, tileSize, workerCount);
+    printf("%.3f s, %.3f M primary rays/s\n", secs, (double)width * height / secs / 1e6);
+    for (int i = 0; i < workerCount; i++) {
+        printf("  thread %2d: %5d tiles, %3d steals, %5.1f%% busy\n", i,
+               workers[i].tiles, workers[i].steals, 100.0 * workers[i].cpuSecs / secs);
+    }
+
+    free(rgb);
+    free(pixels);
+    return 0;
+}
@@ -0,0 +1,61 @@
+// ---------------------------------------------------------------------------
+// ppm.c
+//
+// PPM images, see ppm.h.
+// ---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppm.h"
+
+// ---------------------------------------------------------------------------
+// Same layout as COLOR_FROM_RGB8 in raytracer_float.c: red in the low bits
+// ---------------------------------------------------------------------------
+void rgb555_to_rgb8(uint16_t color, uint8_t *rgb)
+{
+    uint8_t r = color & 0x1F;
+    uint8_t g = (color >> 6) & 0x1F;
+    uint8_t b = color >> 11;
+
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 3) | (g >> 2);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+bool write_ppm(const char *file, const uint8_t *rgb, int width, int height)
+{
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    size_t bytes = (size_t)width * height * 3;
+    bool ok = fwrite(rgb, 1, bytes, f) == bytes;
+    return (fclose(f) == 0) && ok;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+uint8_t *read_ppm(const char *file, int *width, int *height)
+{
+    FILE *f = fopen(file, "rb");
+    int maxval;
+    uint8_t *rgb = NULL;
+
+    if (!f) {
+        return NULL;
+    }
+    if (fscanf(f, "P6 %d %d %d", width, height, &maxval) == 3 && maxval == 255 &&
+        *width > 0 && *height > 0 && fgetc(f) != EOF) {
+        size_t bytes = (size_t)*width * *height * 3;
+        rgb = malloc(bytes);
+        if (rgb && fread(rgb, 1, bytes, f) != bytes) {
+            free(rgb);
+            rgb = NULL;
+        }
+    }
+    fclose(f);
+    return rgb;
+}
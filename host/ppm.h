@@ -0,0 +1,24 @@
+// ---------------------------------------------------------------------------
+// ppm.h
+//
+// Binary PPM (P6) images for the host tools, 8 bits per channel, and the
+// conversion from the tracer's BGR555 colors.
+// ---------------------------------------------------------------------------
+
+#ifndef PPM_H
+#define PPM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 5-bit channels of a BGR555 color widened to 8 bits, into rgb[0..2]
+void rgb555_to_rgb8(uint16_t color, uint8_t *rgb);
+
+// Write width * height RGB triples. Returns false on I/O errors.
+bool write_ppm(const char *file, const uint8_t *rgb, int width, int height);
+
+// Read an image written by write_ppm(), as malloc()ed RGB triples. Returns
+// NULL if the file is missing or not an 8-bit P6.
+uint8_t *read_ppm(const char *file, int *width, int *height);
+
+#endif // PPM_H
@@ -0,0 +1,37 @@
+// ---------------------------------------------------------------------------
+// raytracer_host.h
+//
+// The parts of raytracer_float.c the host tools call. That file has no
+// header of its own, so keep these in step with it. Build it with
+// RAYTRACER_MAIN=0 (host/CMakeLists.txt does).
+// ---------------------------------------------------------------------------
+
+#ifndef RAYTRACER_HOST_H
+#define RAYTRACER_HOST_H
+
+#include <stdint.h>
+
+// Render window on the canvas, see init_render_window()
+extern uint16_t windowWidth;
+extern uint16_t windowHeight;
+
+void init_shade_lut(void);
+void init_render_window(void);
+void init_gbuffer(void);
+void set_render_scale(uint8_t scale);
+void set_trace_size(int width, int height);
+void set_camera(float x, float y, float z, float cosYaw, float sinYaw, float cosPitch, float sinPitch);
+void update_shadow_casters(void); // not in a SCENE_COMPILED build
+void update_row_spans(void);
+void reset_shadow_cache(void);
+
+// BGR555 color of the primary ray through traced pixel (x, y). Thread safe
+// once update_shadow_casters() has run: each thread has its own ray state.
+uint16_t trace_pixel(float x, float y);
+
+// Render the window into the canvas, as the 6502 does
+void render_scene(void);
+void render_scene_progressive(void);
+void render_scene_interleaved(uint8_t passes);
+
+#endif // RAYTRACER_HOST_H
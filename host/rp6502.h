@@ -0,0 +1,64 @@
+// ---------------------------------------------------------------------------
+// rp6502.h (host)
+//
+// Stand-in for the llvm-mos <rp6502.h> when the raytracer is built natively
+// for the tools in host/. XRAM is a 64K array and the two RIA data ports
+// step through it as they do on the hardware, so whatever is drawn can be
+// read back from ria_host.xram. xregn() does nothing; there is no display.
+//
+// Only the parts of the RIA the raytracer uses are here.
+// ---------------------------------------------------------------------------
+
+#ifndef RP6502_H
+#define RP6502_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t xram[0x10000];
+    uint16_t addr0;
+    int8_t step0;
+    uint16_t addr1;
+    int8_t step1;
+} RiaHost;
+
+extern RiaHost ria_host;
+
+// Address of the next access through a port, stepping it afterwards
+static inline uint16_t ria_host_step(uint16_t* addr, int8_t step) {
+    uint16_t a = *addr;
+    *addr += step;
+    return a;
+}
+
+// RIA.rw0 expands to ria_host.xram[...], an lvalue like the real register
+#define RIA ria_host
+#define rw0 xram[ria_host_step(&ria_host.addr0, ria_host.step0)]
+#define rw1 xram[ria_host_step(&ria_host.addr1, ria_host.step1)]
+
+int xregn(char device, char channel, unsigned char address, unsigned count, ...);
+
+typedef struct {
+    bool x_wrap;
+    bool y_wrap;
+    int16_t x_pos_px;
+    int16_t y_pos_px;
+    int16_t width_px;
+    int16_t height_px;
+    uint16_t xram_data_ptr;
+    uint16_t xram_palette_ptr;
+} vga_mode3_config_t;
+
+// Store one member of a config struct in XRAM, little endian like the 6502
+#define xram0_struct_set(addr, type, member, val)                          \
+    do {                                                                   \
+        type ria_host_struct;                                              \
+        ria_host_struct.member = (val);                                    \
+        memcpy(&ria_host.xram[(uint16_t)((addr) + offsetof(type, member))], \
+               &ria_host_struct.member, sizeof(ria_host_struct.member));   \
+    } while (0)
+
+#endif // RP6502_H
@@ -0,0 +1,18 @@
+// ---------------------------------------------------------------------------
+// rp6502_host.c
+//
+// The RIA of the host build, see rp6502.h.
+// ---------------------------------------------------------------------------
+
+#include "rp6502.h"
+
+RiaHost ria_host;
+
+int xregn(char device, char channel, unsigned char address, unsigned count, ...)
+{
+    (void)device;
+    (void)channel;
+    (void)address;
+    (void)count;
+    return 0;
+}
@@ -21,6 +21,8 @@
 #include "font5x7.h"
 #include "colors.h"
 #include "bitmap_graphics.h"
+#include "render_stats.h"
+#include "xram_map.h"
 
 // For drawing lines
 static uint16_t canvas_struct = 0xFF00;
@@ -30,7 +32,8 @@ static uint8_t  canvas_mode = 2;
 static uint16_t canvas_w = 320;
 static uint16_t canvas_h = 180;
 static uint8_t  bpp_mode = 3;
-static uint8_t  bpp = 4;
+static uint16_t reserved_data = XRAM_NULL;   // canvas regions in the XRAM map,
+static uint16_t reserved_struct = XRAM_NULL; // released on the next init
 
 // For drawing characters
 static uint16_t cursor_y = 0;
@@ -40,6 +43,12 @@ static uint16_t textcolor = 15;
 static uint16_t textbgcolor = 15;
 static bool wrap = true;
 
+// For caching transposed glyphs
+#define GLYPH_CACHE_SIZE 16 // power of two
+static uint8_t glyph_cache_code[GLYPH_CACHE_SIZE];
+static bool    glyph_cache_valid[GLYPH_CACHE_SIZE];
+static uint8_t glyph_cache_rows[GLYPH_CACHE_SIZE][8];
+
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
 static uint8_t bpp_mode_to_bpp[] = {1, 2, 4, 8, 16};
@@ -55,7 +64,23 @@ static uint8_t bbp_to_bpp_mode(uint8_t bpp)
     return 2; // default
 }
 
-void init_bitmap_graphics(uint16_t canvas_struct_address,
+// ---------------------------------------------------------------------------
+// Reserve a canvas region in the XRAM map: at address, or wherever it fits
+// if address is XRAM_NULL or overlaps something already reserved. Returns
+// XRAM_NULL if there is no room at all.
+// ---------------------------------------------------------------------------
+static uint16_t reserve_canvas_region(const char *name, uint16_t address,
+                                      uint16_t size, uint16_t align)
+{
+    if (address != XRAM_NULL) {
+        if (xram_reserve_at(name, address, size, align) != XRAM_NULL) {
+            return address;
+        }
+    }
+    return xram_reserve(name, size, align);
+}
+
+bool init_bitmap_graphics(uint16_t canvas_struct_address,
                           uint16_t canvas_data_address,
                           uint8_t  canvas_plane,
                           uint8_t  canvas_type,
@@ -131,11 +156,34 @@ void init_bitmap_graphics(uint16_t canvas_struct_address,
         y_offset = 29; // (240 - 124)/4
     }
 
-    if (canvas_struct_address != canvas_struct) {
+    // claim XRAM for the canvas data and its config struct, letting the XRAM
+    // map place them if the caller passed XRAM_NULL
+    if (reserved_data != XRAM_NULL) {
+        xram_release(reserved_data);
+    }
+    if (reserved_struct != XRAM_NULL) {
+        xram_release(reserved_struct);
+    }
+    reserved_data = reserve_canvas_region("canvas data", canvas_data,
+                                          (uint32_t)canvas_w * canvas_h * bpp_mode_to_bpp[bpp_mode] >> 3,
+                                          bpp_mode_to_bpp[bpp_mode] == 16 ? 2 : 1);
+    reserved_struct = reserve_canvas_region("canvas struct", canvas_struct,
+                                            sizeof(vga_mode3_config_t), 1);
+    if (reserved_data == XRAM_NULL || reserved_struct == XRAM_NULL) {
+        printf("No room in XRAM for the canvas\n");
+        xram_release(reserved_data);
+        xram_release(reserved_struct);
+        reserved_data = reserved_struct = XRAM_NULL;
+        return false;
+    }
+    canvas_data = reserved_data;
+    canvas_struct = reserved_struct;
+
+    if (canvas_struct_address != canvas_struct && canvas_struct_address != XRAM_NULL) {
         printf("Asked for canvas_struct_address of 0x%04X, but got 0x%04X\n", canvas_struct_address, canvas_struct);
     }
-    if (canvas_data_address != canvas_data) {
-        printf("Asked for canvas_data_address of 0x%04X, but got 0x%04X\n", canvas_struct_address, canvas_data);
+    if (canvas_data_address != canvas_data && canvas_data_address != XRAM_NULL) {
+        printf("Asked for canvas_data_address of 0x%04X, but got 0x%04X\n", canvas_data_address, canvas_data);
     }
     if (canvas_type != canvas_mode) {
         printf("Asked for canvas_type of %u, but got %u\n", canvas_type, canvas_mode);
@@ -167,9 +215,10 @@ void init_bitmap_graphics(uint16_t canvas_struct_address,
     //xreg_vga_mode(3, bpp_mode, canvas_struct, plane); // bitmap mode
     xregn(1, 0, 1, 4, 3, bpp_mode, canvas_struct, plane);
 
-    printf("canvas_mode: %i, bpp_mode: %i, canvas_struct: %i, plane: %i\n", canvas_mode, canvas_struct, plane);
+    printf("canvas_mode: %i, bpp_mode: %i, canvas_struct: 0x%04X, plane: %i\n", canvas_mode, bpp_mode, canvas_struct, plane);
 
     //xreg_vga_mode(0, 1); // console
+    return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -193,6 +242,14 @@ uint8_t bits_per_pixel(void)
     return bpp_mode_to_bpp[bpp_mode];
 }
 
+// ---------------------------------------------------------------------------
+// XRAM address of the canvas data, which every primitive draws relative to
+// ---------------------------------------------------------------------------
+uint16_t canvas_address(void)
+{
+    return canvas_data;
+}
+
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
 uint16_t random(uint16_t low_limit, uint16_t high_limit)
@@ -208,40 +265,95 @@ uint16_t random(uint16_t low_limit, uint16_t high_limit)
 // ---------------------------------------------------------------------------
 void erase_canvas(void)
 {
-    uint16_t i, num_bytes;
+    clear_canvas(0);
+}
 
-    if (bpp_mode == 4) { // 16bpp
-        num_bytes = (canvas_w<<1) * canvas_h;
-    } else if (bpp_mode == 3) { // 8bpp
-        num_bytes = canvas_w * canvas_h;
-    } else if (bpp_mode == 2) { // 4bpp
-        num_bytes = (canvas_w>>1) * canvas_h;
-    } else if (bpp_mode == 1) { //2bpp
-        num_bytes = (canvas_w>>2) * canvas_h;
-    } else if (bpp_mode == 0) { //1bpp
-        num_bytes = (canvas_w>>3) * canvas_h;
+// ---------------------------------------------------------------------------
+// Fill the whole canvas with color
+// ---------------------------------------------------------------------------
+void clear_canvas(uint16_t color)
+{
+    fill_rect(color, 0, 0, canvas_w, canvas_h);
+}
+
+// ---------------------------------------------------------------------------
+// Color as stored in a packed (4, 2 or 1bpp) pixel, as draw_pixel does
+// ---------------------------------------------------------------------------
+static uint8_t packed_color(uint16_t color)
+{
+    if (bpp_mode == 2) { // 4bpp
+        return color & 15;
+    } else if (bpp_mode == 1) { // 2bpp
+        if (color > 0 && (color % 4) == 0) {
+            color = 1; // avoid 'accidental' black
+        }
+        return color & 3;
+    }
+    return (color != 0) ? 1 : 0; // 1bpp
+}
+
+// ---------------------------------------------------------------------------
+// Bytes from the start of one canvas row to the next
+// ---------------------------------------------------------------------------
+static uint16_t row_stride(void)
+{
+    return (uint16_t)((uint32_t)canvas_w * bpp_mode_to_bpp[bpp_mode] >> 3);
+}
+
+// ---------------------------------------------------------------------------
+// A packed (4, 2 or 1bpp) color repeated across a whole byte
+// ---------------------------------------------------------------------------
+static uint8_t packed_fill(uint16_t color)
+{
+    uint8_t bits = bpp_mode_to_bpp[bpp_mode];
+    uint8_t c = packed_color(color);
+    uint8_t fill = 0;
+
+    for (uint8_t q = 0; q < 8; q += bits) {
+        fill = (fill << bits) | c;
     }
+    return fill;
+}
+
+// ---------------------------------------------------------------------------
+// Span engine behind hlines, rectangles and clears: write n bytes from the
+// current port 0 address, alternating a and b (the two bytes of a 16bpp
+// color, or the same byte twice).
+//
+// Eight stores per pass lets llvm-mos keep the pass count in one 8-bit
+// register: a store is 4 cycles and the 8-bit decrement and branch about 5,
+// so the loop runs at ~87% of store speed. The old 16-store loop spent ~20
+// cycles per pass on its 16-bit counter (~80%); going to 16 stores here
+// would gain ~6% more for twice the code. These are estimates from cycle
+// counts, not measured on hardware.
+// ---------------------------------------------------------------------------
+static void fill_bytes(uint16_t n, uint8_t a, uint8_t b)
+{
+    uint16_t passes = n >> 3;
+    uint8_t count = (uint8_t)passes;     // first run; 0 means a full 256
+    uint8_t runs = (passes + 255) >> 8;  // runs of up to 256 passes
+    uint8_t tail;
 
-    RIA.addr0 = canvas_data;
     RIA.step0 = 1;
-    for (i = 0; i < (num_bytes/16); i++) {
-        // unrolled for speed
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
-        RIA.rw0 = 0;
+    while (runs--) {
+        do {
+            RIA.rw0 = a;
+            RIA.rw0 = b;
+            RIA.rw0 = a;
+            RIA.rw0 = b;
+            RIA.rw0 = a;
+            RIA.rw0 = b;
+            RIA.rw0 = a;
+            RIA.rw0 = b;
+        } while (--count);
+    }
+
+    for (tail = n & 7; tail >= 2; tail -= 2) {
+        RIA.rw0 = a;
+        RIA.rw0 = b;
+    }
+    if (tail) {
+        RIA.rw0 = a;
     }
 }
 
@@ -250,24 +362,27 @@ void erase_canvas(void)
 // ---------------------------------------------------------------------------
 void draw_pixel(uint16_t color, uint16_t x, uint16_t y)
 {
+    STATS_INC(addrSetups);
+    STATS_ADD(riaBytes, (bpp_mode == 4) ? 2 : 1);
+
     if (bpp_mode == 4) { // 16bpp
         // RIA.addr0 = canvas_w*2 * y + x*2;
-        RIA.addr0 = (canvas_w << 1) * y + (x << 1);
+        RIA.addr0 = canvas_data + (canvas_w << 1) * y + (x << 1);
         RIA.step0 = 1;
         RIA.rw0 = color;
         RIA.rw0 = color >> 8;
     } else if (bpp_mode == 3) { // 8bpp
-        RIA.addr0 = canvas_w * y + x;
+        RIA.addr0 = canvas_data + canvas_w * y + x;
         RIA.step0 = 1;
         RIA.rw0 = color;
     } else if (bpp_mode == 2) { // 4bpp
         uint8_t shift = 4 * (1 - (x & 1));
-        RIA.addr0 = canvas_w/2 * y + x/2;
+        RIA.addr0 = canvas_data + canvas_w/2 * y + x/2;
         RIA.step0 = 0;
         RIA.rw0 = (RIA.rw0 & ~(15 << shift)) | ((color & 15) << shift);
     } else if (bpp_mode == 1) { // 2bpp
         uint8_t shift = 2 * (3 - (x & 3));
-        RIA.addr0 = canvas_w/4 * y + x/4;
+        RIA.addr0 = canvas_data + canvas_w/4 * y + x/4;
         RIA.step0 = 0;
         if (color > 0 && (color % 4) == 0) {
             color = 1; // avoid 'accidental' black
@@ -275,7 +390,7 @@ void draw_pixel(uint16_t color, uint16_t x, uint16_t y)
         RIA.rw0 = (RIA.rw0 & ~(3 << shift)) | ((color & 3) << shift);
     } else if (bpp_mode == 0) { // 1bpp
         uint8_t shift = 1 * (7 - (x & 7));
-        RIA.addr0 = canvas_w/8 * y + x/8;
+        RIA.addr0 = canvas_data + canvas_w/8 * y + x/8;
         RIA.step0 = 0;
         color = (color != 0) ? 1 : 0;
         RIA.rw0 = (RIA.rw0 & ~(1 << shift)) | ((color & 1) << shift);
@@ -283,35 +398,83 @@ void draw_pixel(uint16_t color, uint16_t x, uint16_t y)
 }
 
 // ---------------------------------------------------------------------------
+// When a canvas row fits in the signed 8-bit RIA step, the whole line is one
+// span walked with step = row stride; 16bpp uses port 0 for the low bytes and
+// port 1 for the high bytes, packed modes read on port 0 and write on port 1.
+// Otherwise every pixel needs its own address.
 // ---------------------------------------------------------------------------
 void draw_vline(uint16_t color, uint16_t x, uint16_t y, uint16_t h)
 {
-    if (bpp_mode == 4) { // Only optimize for 16bpp mode
-        uint16_t row_addr;
+    uint16_t stride = row_stride();
+
+    if (h == 0) {
+        return;
+    }
+
+    if (stride <= 127) {
+        uint8_t bits = bpp_mode_to_bpp[bpp_mode];
+
+        STATS_ADD(addrSetups, 2);
+        STATS_ADD(riaBytes, (uint32_t)h << 1);
+
+        if (bpp_mode == 4) { // 16bpp
+            uint16_t addr = canvas_data + stride * y + (x << 1);
+            RIA.addr0 = addr;
+            RIA.step0 = stride;
+            RIA.addr1 = addr + 1;
+            RIA.step1 = stride;
+            for (uint16_t i = 0; i < h; i++) {
+                RIA.rw0 = color;
+                RIA.rw1 = color >> 8;
+            }
+        } else if (bpp_mode == 3) { // 8bpp
+            RIA.addr0 = canvas_data + stride * y + x;
+            RIA.step0 = stride;
+            for (uint16_t i = 0; i < h; i++) {
+                RIA.rw0 = color;
+            }
+        } else { // 4, 2 and 1bpp
+            uint8_t per_byte = 8 / bits;
+            uint8_t shift = (per_byte - 1 - (x & (per_byte - 1))) * bits;
+            uint8_t mask = ((1 << bits) - 1) << shift;
+            uint8_t value = packed_color(color) << shift;
+            uint16_t addr = canvas_data + stride * y + x / per_byte;
+            RIA.addr0 = addr;
+            RIA.step0 = stride;
+            RIA.addr1 = addr;
+            RIA.step1 = stride;
+            for (uint16_t i = 0; i < h; i++) {
+                RIA.rw1 = (RIA.rw0 & ~mask) | value;
+            }
+        }
+    } else if (bpp_mode == 4) { // 16bpp
+        uint16_t row_addr = canvas_data + stride * y + (x << 1);
         uint8_t color_low = color & 0xFF;
         uint8_t color_high = color >> 8;
 
-        for (uint16_t i = 0; i < h; i++) {
-            // Calculate the address for the current pixel in the column
-            row_addr = ((canvas_w << 1) * (y + i)) + (x << 1);
+        STATS_ADD(addrSetups, h);
+        STATS_ADD(riaBytes, (uint32_t)h << 1);
 
+        RIA.step0 = 1;
+        for (uint16_t i = 0; i < h; i++) {
             // Set the address and color for the current pixel
             RIA.addr0 = row_addr;
-            RIA.step0 = 1;
             RIA.rw0 = color_low;
             RIA.rw0 = color_high;
+            row_addr += stride;
         }
-    } else if (bpp_mode == 3) { // Only optimize for 8bpp mode
-        uint16_t row_addr;
+    } else if (bpp_mode == 3) { // 8bpp
+        uint16_t row_addr = canvas_data + stride * y + x;
 
-        for (uint16_t i = 0; i < h; i++) {
-            // Calculate the address for the current pixel in the column
-            row_addr = ((canvas_w) * (y + i)) + (x );
+        STATS_ADD(addrSetups, h);
+        STATS_ADD(riaBytes, h);
 
+        RIA.step0 = 1;
+        for (uint16_t i = 0; i < h; i++) {
             // Set the address and color for the current pixel
             RIA.addr0 = row_addr;
-            RIA.step0 = 1;
             RIA.rw0 = color;
+            row_addr += stride;
         }
     }
     else {
@@ -330,34 +493,60 @@ void draw_hline(uint16_t color, uint16_t x, uint16_t y, uint16_t w)
         uint8_t color_high = color >> 8;
 
         // Calculate the starting address for the horizontal line
-        row_addr = ((canvas_w << 1) * y) + (x << 1);
+        row_addr = canvas_data + ((canvas_w << 1) * y) + (x << 1);
 
-        // Set the address and step for horizontal line
-        RIA.addr0 = row_addr;
-        RIA.step0 = 1; // Move 2 bytes per pixel in 16bpp mode
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, (uint32_t)w << 1);
 
-        for (uint16_t i = 0; i < w; i++) {
-            RIA.rw0 = color_low;
-            RIA.rw0 = color_high;
-        }
+        // Set the address for horizontal line
+        RIA.addr0 = row_addr;
+        fill_bytes(w << 1, color_low, color_high);
     } else if (bpp_mode == 3) { // Only optimize for 89bpp mode
         uint16_t row_addr;
 
         // Calculate the starting address for the horizontal line
-        row_addr = ((canvas_w) * y) + (x);
+        row_addr = canvas_data + ((canvas_w) * y) + (x);
 
-        // Set the address and step for horizontal line
-        RIA.addr0 = row_addr;
-        RIA.step0 = 1; // Move 2 bytes per pixel in 16bpp mode
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, w);
 
-        for (uint16_t i = 0; i < w; i++) {
-            RIA.rw0 = color;
-        }
+        // Set the address for horizontal line
+        RIA.addr0 = row_addr;
+        fill_bytes(w, color, color);
     }
-     else {
-        // Fallback for other bpp modes
-        for (uint16_t i = x; i < (x + w); i++) {
-            draw_pixel(color, i, y);
+    else if (w > 0) { // 4, 2 and 1bpp
+        uint8_t bits = bpp_mode_to_bpp[bpp_mode];
+        uint8_t per_byte = 8 / bits;
+        uint8_t fill = packed_fill(color);
+        uint8_t p = x & (per_byte - 1); // first pixel within the first byte
+        uint8_t q;
+
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, (p + w + per_byte - 1) / per_byte);
+
+        RIA.addr0 = canvas_data + row_stride() * y + x / per_byte;
+
+        // Partial first byte: read it in place, then write and advance
+        if (p) {
+            uint8_t mask, byte;
+            q = (p + w < per_byte) ? p + w : per_byte;
+            mask = (0xFF >> (p * bits)) & (0xFF << ((per_byte - q) * bits));
+            RIA.step0 = 0;
+            byte = (RIA.rw0 & ~mask) | (fill & mask);
+            RIA.step0 = 1;
+            RIA.rw0 = byte;
+            w -= q - p;
+        }
+
+        // Whole bytes
+        fill_bytes(w / per_byte, fill, fill);
+        w &= per_byte - 1;
+
+        // Partial last byte
+        if (w) {
+            uint8_t mask = 0xFF << ((per_byte - w) * bits);
+            RIA.step0 = 0;
+            RIA.rw0 = (RIA.rw0 & ~mask) | (fill & mask);
         }
     }
 }
@@ -371,6 +560,7 @@ void draw_line(uint16_t color, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
     int16_t dx, dy;
     int16_t err;
     int16_t ystep;
+    int16_t run;
     int16_t steep = abs(y1 - y0) > abs(x1 - x0);
 
     if (steep) {
@@ -394,15 +584,20 @@ void draw_line(uint16_t color, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
         ystep = -1;
     }
 
+    // Draw the line as runs along the major axis, one span per run
+    run = x0;
     for (; x0<=x1; x0++) {
-        if (steep) {
-            draw_pixel(color, y0, x0);
-        } else {
-            draw_pixel(color, x0, y0);
-        }
-
         err -= dy;
 
+        if (err < 0 || x0 == x1) {
+            if (steep) {
+                draw_vline(color, y0, run, x0 - run + 1);
+            } else {
+                draw_hline(color, run, y0, x0 - run + 1);
+            }
+            run = x0 + 1;
+        }
+
         if (err < 0) {
             y0 += ystep;
             err += dx;
@@ -434,71 +629,44 @@ void draw_rect(uint16_t color, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 
 void fill_rect(uint16_t color, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
-    if (bpp_mode == 4) { // Only optimize for 16bpp mode
-        uint16_t row_addr;
-        
-        // Precompute the color bytes
-        uint8_t color_low = color & 0xFF;
-        uint8_t color_high = color >> 8;
+    uint16_t stride = row_stride();
+    uint8_t a, b;
 
-        // Loop through each row
-        for (uint16_t j = 0; j < h; j++) {
-            // Calculate the starting address of the row
-            row_addr = ((canvas_w << 1) * (y + j)) + (x << 1);
-            
-            // Set the initial address and step for the row
-            RIA.addr0 = row_addr;
-            RIA.step0 = 1; // Move 2 bytes per pixel in 16bpp mode
+    if (w == 0 || h == 0) {
+        return;
+    }
 
-            // Fill the row with the color
-            for (uint16_t i = 0; i < w; i++) {
-                RIA.rw0 = color_low;
-                RIA.rw0 = color_high;
-            }
-        }
+    if (bpp_mode == 4) {
+        a = color & 0xFF;
+        b = color >> 8;
     } else {
-        // Fallback to the original implementation for other bpp modes
-        for (uint16_t i = x; i < (x + w); i++) {
-            for (uint16_t j = y; j < (y + h); j++) {
-                draw_pixel(color, i, j);
-            }
-        }
+        a = b = (bpp_mode == 3) ? color : packed_fill(color);
     }
-}
 
-void fill_rect_fast(uint16_t color, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-    if (bpp_mode != 4) {
-        fill_rect(color, x, y, w, h);
-        return;
-    }
+    if (x == 0 && w == canvas_w) {
+        // Whole rows are contiguous in XRAM: one run for the lot
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, (uint32_t)stride * h);
 
-    // 16bpp mode optimization
-    uint16_t start_addr = (canvas_w << 1) * y + (x << 1);
-    uint16_t end_addr = start_addr + (w << 1) * h;
+        RIA.addr0 = canvas_data + stride * y;
+        fill_bytes(stride * h, a, b);
+    } else if (bpp_mode >= 3) { // 16 and 8bpp
+        uint16_t span = (bpp_mode == 4) ? w << 1 : w;
+        uint16_t row_addr = canvas_data + stride * y + ((bpp_mode == 4) ? x << 1 : x);
 
-    // Set up RIA for 16bpp mode once
-    RIA.addr0 = start_addr;
-    RIA.step0 = 2; // Increment address by 2 for 16-bit writes
-    RIA.rw0 = color;
-    RIA.rw0 = color >> 8;
+        STATS_ADD(addrSetups, h);
+        STATS_ADD(riaBytes, (uint32_t)span * h);
 
-    
-    // Loop-unrolling and batch pixel writes
-    uint16_t i, j;
-    for (i = 0; i < h; i++) {
-        for (j = 0; j < w; j += 4) {
-            RIA.rw0 = color;
-            RIA.rw0 = color >> 8;
-            RIA.rw0 = color;
-            RIA.rw0 = color >> 8;
-            RIA.rw0 = color;
-            RIA.rw0 = color >> 8;
-            RIA.rw0 = color;
-            RIA.rw0 = color >> 8;
+        for (; h > 0; h--, row_addr += stride) {
+            RIA.addr0 = row_addr;
+            fill_bytes(span, a, b);
+        }
+    } else {
+        // Packed modes fill a span per row, with partial bytes at the ends
+        for (uint16_t j = y; j < (y + h); j++) {
+            draw_hline(color, x, j, w);
         }
-        RIA.addr0 += canvas_w << 1; // Move to the next line
     }
-    
 }
 
 // ---------------------------------------------------------------------------
@@ -581,21 +749,54 @@ void draw_circle(uint16_t color, uint16_t x0, uint16_t y0, uint16_t r)
     }
 }
 
+// ---------------------------------------------------------------------------
+// Fill rows y0-d and y0+delta+d of the filled circle quadrants, w pixels
+// right (cornername 1) and/or left (cornername 2) of x0
+// ---------------------------------------------------------------------------
+static void fill_circle_rows(uint16_t color,
+                             int16_t x0, int16_t y0, int16_t d, int16_t w,
+                             uint8_t cornername, int16_t delta)
+{
+    int16_t left  = (cornername & 0x2) ? x0 - w : x0;
+    int16_t right = (cornername & 0x1) ? x0 + w : x0;
+
+    if (d == 0) {
+        return; // the rows between the halves are filled on their own
+    }
+
+    draw_hline(color, left, y0 - d, right - left + 1);
+    draw_hline(color, left, y0 + delta + d, right - left + 1);
+}
+
 // ---------------------------------------------------------------------------
 // This seems to draw filled circle quadrants
+// Filled as horizontal spans of one address setup each: every row is drawn
+// at the widest the midpoint circle reaches on it, once it's known.
 // ---------------------------------------------------------------------------
 static void fill_circle_helper(uint16_t color,
                                uint16_t x0, uint16_t y0, uint16_t r,
-                               uint8_t cornername, uint16_t delta)
+                               uint8_t cornername, int16_t delta)
 {
     int16_t f     = 1 - r;
     int16_t ddF_x = 1;
     int16_t ddF_y = -2 * r;
     int16_t x     = 0;
     int16_t y     = r;
+    int16_t left  = (cornername & 0x2) ? x0 - r : x0;
+    int16_t right = (cornername & 0x1) ? x0 + r : x0;
+
+    if (r == 0) {
+        return;
+    }
+
+    // rows between the two halves are filled to the full radius
+    for (int16_t i = 0; i <= delta; i++) {
+        draw_hline(color, left, y0 + i, right - left + 1);
+    }
 
     while (x<y) {
         if (f >= 0) {
+            fill_circle_rows(color, x0, y0, y, x, cornername, delta); // last row at this y
             y--;
             ddF_y += 2;
             f     += ddF_y;
@@ -605,23 +806,20 @@ static void fill_circle_helper(uint16_t color,
         ddF_x += 2;
         f     += ddF_x;
 
-        if (cornername & 0x1) {
-            draw_vline(color, x0+x, y0-y, 2*y+1+delta);
-            draw_vline(color, x0+y, y0-x, 2*x+1+delta);
-        }
-        if (cornername & 0x2) {
-            draw_vline(color, x0-x, y0-y, 2*y+1+delta);
-            draw_vline(color, x0-y, y0-x, 2*x+1+delta);
-        }
+        fill_circle_rows(color, x0, y0, x, y, cornername, delta);
     }
+    fill_circle_rows(color, x0, y0, y, x, cornername, delta);
 }
 
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
 void fill_circle(uint16_t color, uint16_t x0, uint16_t y0, uint16_t r)
 {
-    draw_vline(color, x0, y0-r, 2*r+1);
-    fill_circle_helper(color, x0, y0, r, 3, 0);
+    if (r == 0) {
+        draw_pixel(color, x0, y0);
+    } else {
+        fill_circle_helper(color, x0, y0, r, 3, 0);
+    }
 }
 
 // ---------------------------------------------------------------------------
@@ -700,41 +898,181 @@ void set_text_wrap(bool w)
 }
 
 // ---------------------------------------------------------------------------
-// Draw a character at x, y
+// The font is stored a column per byte. Return the glyph transposed to a row
+// per byte (bit i = column i, 6 columns including the blank one), from a
+// small direct-mapped cache so repeated characters skip the transpose.
 // ---------------------------------------------------------------------------
-void draw_char(char chr, uint16_t x, uint16_t y)
+static const uint8_t *glyph_rows(char chr)
 {
+    uint8_t code = (uint8_t)chr;
+    uint8_t slot = code & (GLYPH_CACHE_SIZE - 1);
+    uint8_t *rows = glyph_cache_rows[slot];
     uint8_t i, j;
 
-    if((x >= canvas_w) ||    // Clip right
-       (y >= canvas_h)  ) { // Clip bottom
+    if (glyph_cache_valid[slot] && glyph_cache_code[slot] == code) {
+        return rows;
+    }
+
+    for (j = 0; j < 8; j++) {
+        rows[j] = 0;
+    }
+    for (i = 0; i < 5; i++) {
+        uint8_t line = pgm_read_byte(font+(code*5)+i);
+        for (j = 0; j < 8; j++) {
+            if (line & 0x1) {
+                rows[j] |= 1 << i;
+            }
+            line >>= 1;
+        }
+    }
+
+    glyph_cache_code[slot] = code;
+    glyph_cache_valid[slot] = true;
+    return rows;
+}
+
+// ---------------------------------------------------------------------------
+// Blit w canvas pixels of one glyph row at 16 or 8bpp. Opaque text is one
+// auto-increment span, transparent text one span per run of set pixels.
+// ---------------------------------------------------------------------------
+static void blit_glyph_row(uint8_t row, uint16_t x, uint16_t y, uint16_t w)
+{
+    uint8_t wide = (bpp_mode == 4); // 2 bytes per pixel
+    uint16_t row_addr = canvas_data + ((canvas_w * y + x) << wide);
+    uint16_t i = 0;
+    uint8_t m = 0;
+
+    if (textbgcolor != textcolor) {
+        uint8_t fg_low = textcolor, fg_high = textcolor >> 8;
+        uint8_t bg_low = textbgcolor, bg_high = textbgcolor >> 8;
+
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, w << wide);
+
+        RIA.addr0 = row_addr;
+        RIA.step0 = 1;
+        for (; i < w; i++) {
+            if (row & 0x1) {
+                RIA.rw0 = fg_low;
+                if (wide) RIA.rw0 = fg_high;
+            } else {
+                RIA.rw0 = bg_low;
+                if (wide) RIA.rw0 = bg_high;
+            }
+            if (++m == textmultiplier) {
+                m = 0;
+                row >>= 1;
+            }
+        }
         return;
     }
 
-    for (i=0; i<6; i++ ) {
-        uint8_t line;
+    while (row && i < w) {
+        // skip a clear column
+        if (!(row & 0x1)) {
+            i += textmultiplier;
+            row >>= 1;
+            continue;
+        }
 
-        if (i == 5) {
-            line = 0x0;
-        } else {
-            line = pgm_read_byte(font+(chr*5)+i);
+        // write the run of set columns starting here
+        STATS_INC(addrSetups);
+        RIA.addr0 = row_addr + (i << wide);
+        RIA.step0 = 1;
+        while ((row & 0x1) && i < w) {
+            for (m = 0; m < textmultiplier && i < w; m++, i++) {
+                STATS_ADD(riaBytes, 1 + wide);
+                RIA.rw0 = textcolor;
+                if (wide) RIA.rw0 = textcolor >> 8;
+            }
+            row >>= 1;
         }
+    }
+}
 
-        for ( j = 0; j<8; j++) {
-            if (line & 0x1) {
-                if (textmultiplier == 1) { // default size
-                    draw_pixel(textcolor, x+i, y+j);
-                } else {  // big size
-                    fill_rect(textcolor, x+(i*textmultiplier), y+(j*textmultiplier), textmultiplier, textmultiplier);
-                }
-            } else if (textbgcolor != textcolor) {
-                if (textmultiplier == 1) { // default size
-                    draw_pixel(textbgcolor, x+i, y+j);
-                } else {  // big size
-                    fill_rect(textbgcolor, x+(i*textmultiplier), y+(j*textmultiplier), textmultiplier, textmultiplier);
-                }
+// ---------------------------------------------------------------------------
+// Blit w canvas pixels of one glyph row at 4, 2 or 1bpp. The row's bytes are
+// read through RIA port 0 and written back through port 1, so the whole row
+// is a single span on each port.
+// ---------------------------------------------------------------------------
+static void blit_glyph_row_packed(uint8_t row, uint16_t x, uint16_t y, uint16_t w)
+{
+    uint8_t bits = bpp_mode_to_bpp[bpp_mode];
+    uint8_t per_byte = 8 / bits;
+    uint8_t mask = (1 << bits) - 1;
+    uint8_t fg = packed_color(textcolor);
+    uint8_t bg = packed_color(textbgcolor);
+    bool opaque = (textbgcolor != textcolor);
+    uint16_t addr = canvas_data + (uint16_t)(((uint32_t)canvas_w * y + x) * bits >> 3);
+    uint8_t p = x & (per_byte - 1); // pixel within the byte
+    uint8_t m = 0;
+    uint8_t byte;
+
+    STATS_ADD(addrSetups, 2);
+    STATS_ADD(riaBytes, ((p + w + per_byte - 1) / per_byte) << 1);
+
+    RIA.addr0 = addr;
+    RIA.step0 = 1;
+    RIA.addr1 = addr;
+    RIA.step1 = 1;
+    byte = RIA.rw0;
+
+    for (uint16_t i = 0; i < w; i++) {
+        if ((row & 0x1) || opaque) {
+            uint8_t shift = (per_byte - 1 - p) * bits;
+            byte = (byte & ~(mask << shift)) | (((row & 0x1) ? fg : bg) << shift);
+        }
+        if (++m == textmultiplier) {
+            m = 0;
+            row >>= 1;
+        }
+        if (++p == per_byte) {
+            RIA.rw1 = byte;
+            p = 0;
+            if (i + 1 < w) {
+                byte = RIA.rw0;
             }
-            line >>= 1;
+        }
+    }
+    if (p) {
+        RIA.rw1 = byte;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Draw a character at x, y, a glyph row at a time
+// ---------------------------------------------------------------------------
+void draw_char(char chr, uint16_t x, uint16_t y)
+{
+    const uint8_t *rows;
+    uint16_t w, h, j;
+    uint8_t m = 0;
+
+    if((x >= canvas_w) ||    // Clip right
+       (y >= canvas_h)  ) { // Clip bottom
+        return;
+    }
+
+    rows = glyph_rows(chr);
+
+    w = 6 * textmultiplier;
+    h = 8 * textmultiplier;
+    if (x + w > canvas_w) {
+        w = canvas_w - x;
+    }
+    if (y + h > canvas_h) {
+        h = canvas_h - y;
+    }
+
+    for (j = 0; j < h; j++) {
+        if (bpp_mode >= 3) {
+            blit_glyph_row(*rows, x, y + j, w);
+        } else if (*rows || textbgcolor != textcolor) { // blank transparent rows leave the canvas alone
+            blit_glyph_row_packed(*rows, x, y + j, w);
+        }
+        if (++m == textmultiplier) {
+            m = 0;
+            rows++;
         }
     }
 }
@@ -27,7 +27,7 @@
 // For accessing the font library
 #define pgm_read_byte(addr) (*(const unsigned char *)(addr))
 
-void init_bitmap_graphics(uint16_t canvas_struct_address,
+bool init_bitmap_graphics(uint16_t canvas_struct_address,
                           uint16_t canvas_data_address,
                           uint8_t  canvas_plane,
                           uint8_t  canvas_type,
@@ -37,10 +37,12 @@ void init_bitmap_graphics(uint16_t canvas_struct_address,
 uint16_t canvas_width(void);
 uint16_t canvas_height(void);
 uint8_t bits_per_pixel(void);
+uint16_t canvas_address(void);
 
 uint16_t random(uint16_t low_limit, uint16_t high_limit);
 
 void erase_canvas(void);
+void clear_canvas(uint16_t color);
 void draw_pixel(uint16_t color, uint16_t x, uint16_t y);
 void draw_vline(uint16_t color, uint16_t x, uint16_t y, uint16_t h);
 void draw_hline(uint16_t color, uint16_t x, uint16_t y, uint16_t w);
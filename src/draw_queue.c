@@ -0,0 +1,167 @@
+// ---------------------------------------------------------------------------
+// draw_queue.c
+//
+// Batched drawing commands, see draw_queue.h.
+// ---------------------------------------------------------------------------
+
+#include "bitmap_graphics.h"
+#include "draw_queue.h"
+
+// Every command is a filled rectangle; pixels and lines are 1 high
+typedef struct {
+    uint16_t color;
+    uint16_t x, y, w, h;
+} DrawCommand;
+
+// Queued commands in the order they were pushed. Commands of different
+// colors never overlap in here, so they can be drawn in any order.
+static DrawCommand queue[DRAW_QUEUE_SIZE];
+static uint8_t queue_count = 0;
+
+// ---------------------------------------------------------------------------
+// Sort into canvas order, top to bottom then left to right, which is also
+// XRAM address order in every bpp. The queue is short and mostly sorted
+// already, so an insertion sort is enough.
+// ---------------------------------------------------------------------------
+static void sort_queue(void)
+{
+    for (uint8_t i = 1; i < queue_count; i++) {
+        DrawCommand c = queue[i];
+        uint8_t j = i;
+
+        while (j > 0 && (queue[j - 1].y > c.y || (queue[j - 1].y == c.y && queue[j - 1].x > c.x))) {
+            queue[j] = queue[j - 1];
+            j--;
+        }
+        queue[j] = c;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Join commands of the same color and rows that touch or overlap on the
+// left-right axis. Needs a sorted queue; returns the new length.
+// ---------------------------------------------------------------------------
+static uint8_t merge_rows(void)
+{
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < queue_count; i++) {
+        DrawCommand *c = &queue[i];
+
+        if (n > 0) {
+            DrawCommand *p = &queue[n - 1];
+            if (p->y == c->y && p->h == c->h && p->color == c->color && p->x + p->w >= c->x) {
+                if (c->x + c->w > p->x + p->w) {
+                    p->w = c->x + c->w - p->x;
+                }
+                continue;
+            }
+        }
+        queue[n++] = *c;
+    }
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+// Stack commands of the same color and columns that sit right on top of
+// each other. Merged commands are left with w = 0.
+// ---------------------------------------------------------------------------
+static void merge_columns(uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++) {
+        DrawCommand *a = &queue[i];
+        if (a->w == 0) {
+            continue;
+        }
+        // Sorted by y, so a whole column is picked up in one sweep
+        for (uint8_t j = i + 1; j < n; j++) {
+            DrawCommand *b = &queue[j];
+            if (b->w == a->w && b->x == a->x && b->color == a->color && b->y == a->y + a->h) {
+                a->h += b->h;
+                b->w = 0;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Draw and empty the queue
+// ---------------------------------------------------------------------------
+void flush_draw_queue(void)
+{
+    uint8_t n;
+
+    if (queue_count == 0) {
+        return;
+    }
+
+    sort_queue();
+    n = merge_rows();
+    merge_columns(n);
+
+    for (uint8_t i = 0; i < n; i++) {
+        DrawCommand *c = &queue[i];
+        if (c->w == 0) {
+            continue;
+        }
+        if (c->h == 1) {
+            if (c->w == 1) {
+                draw_pixel(c->color, c->x, c->y);
+            } else {
+                draw_hline(c->color, c->x, c->y, c->w);
+            }
+        } else {
+            fill_rect(c->color, c->x, c->y, c->w, c->h);
+        }
+    }
+    queue_count = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Queue a filled rectangle. A rectangle of the same color that is already
+// queued and covers it makes it a no-op; one of another color that overlaps
+// it has to be drawn first, so the queue is flushed.
+// ---------------------------------------------------------------------------
+void queue_fill_rect(uint16_t color, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if (w == 0 || h == 0) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < queue_count; i++) {
+        DrawCommand *q = &queue[i];
+        if (x < q->x + q->w && q->x < x + w && y < q->y + q->h && q->y < y + h) {
+            if (q->color != color) {
+                flush_draw_queue();
+                break;
+            }
+            if (x >= q->x && x + w <= q->x + q->w && y >= q->y && y + h <= q->y + q->h) {
+                return;
+            }
+        }
+    }
+
+    if (queue_count == DRAW_QUEUE_SIZE) {
+        flush_draw_queue();
+    }
+    queue[queue_count].color = color;
+    queue[queue_count].x = x;
+    queue[queue_count].y = y;
+    queue[queue_count].w = w;
+    queue[queue_count].h = h;
+    queue_count++;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void queue_hline(uint16_t color, uint16_t x, uint16_t y, uint16_t w)
+{
+    queue_fill_rect(color, x, y, w, 1);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void queue_pixel(uint16_t color, uint16_t x, uint16_t y)
+{
+    queue_fill_rect(color, x, y, 1, 1);
+}
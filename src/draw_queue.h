@@ -0,0 +1,28 @@
+// ---------------------------------------------------------------------------
+// draw_queue.h
+//
+// Batched drawing: pixels, horizontal lines and filled rectangles are queued
+// in a fixed-size buffer instead of being drawn one by one. A flush sorts the
+// queue into canvas (XRAM address) order, merges commands that touch or
+// repeat each other into fewer, larger spans and then draws them through
+// bitmap_graphics.
+//
+// The queue is meant to sit between the tracer and the canvas: the tracer
+// pushes results while it computes the next block and the queue drains
+// itself whenever it fills up. Anything that reads the canvas back, or draws
+// over queued areas directly, has to flush_draw_queue() first.
+// ---------------------------------------------------------------------------
+
+#ifndef DRAW_QUEUE_H
+#define DRAW_QUEUE_H
+
+#include <stdint.h>
+
+#define DRAW_QUEUE_SIZE 32
+
+void queue_pixel(uint16_t color, uint16_t x, uint16_t y);
+void queue_hline(uint16_t color, uint16_t x, uint16_t y, uint16_t w);
+void queue_fill_rect(uint16_t color, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+void flush_draw_queue(void);
+
+#endif // DRAW_QUEUE_H
@@ -0,0 +1,122 @@
+// ---------------------------------------------------------------------------
+// primitives_bench.c
+//
+// Measures how many of each bitmap_graphics primitive can be drawn per
+// second in every bpp mode, printed as a table on the console. It only uses
+// the public bitmap_graphics API, so building it against an older
+// bitmap_graphics.c gives the numbers to compare against.
+// ---------------------------------------------------------------------------
+
+#include <rp6502.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "bitmap_graphics.h"
+#include "xram_map.h"
+
+#define BENCH_TICKS (CLOCKS_PER_SEC / 2) // time spent on each primitive
+
+enum {
+    PRIM_PIXEL,
+    PRIM_HLINE,
+    PRIM_VLINE,
+    PRIM_LINE,
+    PRIM_FILL_RECT,
+    PRIM_FILL_CIRCLE,
+    PRIM_FILL_ROUNDED_RECT,
+    PRIM_CHAR,
+    PRIM_CLEAR,
+    PRIM_COUNT
+};
+
+static const char *prim_names[PRIM_COUNT] = {
+    "pixel", "hline", "vline", "line", "rect", "circle", "rrect", "char", "clear"
+};
+
+static const uint8_t bpps[] = {16, 8, 4, 2, 1};
+
+// Draw one primitive of a fixed size at a random place on the canvas
+static void draw_primitive(uint8_t prim, uint16_t color)
+{
+    uint16_t w = canvas_width();
+    uint16_t h = canvas_height();
+
+    switch (prim) {
+        case PRIM_PIXEL:
+            draw_pixel(color, random(0, w - 1), random(0, h - 1));
+            break;
+        case PRIM_HLINE:
+            draw_hline(color, random(0, w - 65), random(0, h - 1), 64);
+            break;
+        case PRIM_VLINE:
+            draw_vline(color, random(0, w - 1), random(0, h - 65), 64);
+            break;
+        case PRIM_LINE:
+            draw_line(color, random(0, w - 1), random(0, h - 1), random(0, w - 1), random(0, h - 1));
+            break;
+        case PRIM_FILL_RECT:
+            fill_rect(color, random(0, w - 33), random(0, h - 33), 32, 32);
+            break;
+        case PRIM_FILL_CIRCLE:
+            fill_circle(color, random(16, w - 17), random(16, h - 17), 16);
+            break;
+        case PRIM_FILL_ROUNDED_RECT:
+            fill_rounded_rect(color, random(0, w - 49), random(0, h - 33), 48, 32, 8);
+            break;
+        case PRIM_CHAR:
+            set_text_colors(color, ~color);
+            draw_char('A' + (color & 15), random(0, w - 7), random(0, h - 9));
+            break;
+        case PRIM_CLEAR:
+            erase_canvas(); // not clear_canvas, so older builds compare
+            break;
+    }
+}
+
+// Primitives drawn per second
+static uint32_t bench_primitive(uint8_t prim)
+{
+    uint32_t count = 0;
+    clock_t start = clock();
+
+    while (clock() - start < BENCH_TICKS) {
+        draw_primitive(prim, count);
+        count++;
+    }
+    return count * CLOCKS_PER_SEC / BENCH_TICKS;
+}
+
+int main()
+{
+    uint32_t results[sizeof(bpps)][PRIM_COUNT];
+
+    for (uint8_t b = 0; b < sizeof(bpps); b++) {
+        xram_reset();
+        // 320x180 doesn't fit in XRAM at 16bpp
+        if (bpps[b] == 16) {
+            init_bitmap_graphics(XRAM_NULL, XRAM_NULL, 0, 2, 240, 124, bpps[b]);
+        } else {
+            init_bitmap_graphics(XRAM_NULL, XRAM_NULL, 0, 2, 320, 180, bpps[b]);
+        }
+        erase_canvas();
+        for (uint8_t prim = 0; prim < PRIM_COUNT; prim++) {
+            results[b][prim] = bench_primitive(prim);
+        }
+    }
+
+    printf("primitives per second\n");
+    printf("%-7s", "bpp");
+    for (uint8_t b = 0; b < sizeof(bpps); b++) {
+        printf("%7u", bpps[b]);
+    }
+    printf("\n");
+    for (uint8_t prim = 0; prim < PRIM_COUNT; prim++) {
+        printf("%-7s", prim_names[prim]);
+        for (uint8_t b = 0; b < sizeof(bpps); b++) {
+            printf("%7lu", (unsigned long)results[b][prim]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -1,21 +1,83 @@
 #include <rp6502.h>
 // #include "qfp16.h"
-#include <float.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include "bitmap_graphics.h"
-
-#define COLOR_FROM_RGB8(r,g,b) (((b>>3)<<11)|((g>>3)<<6)|(r>>3))
+#include "draw_queue.h"
+#include "render_stats.h"
+#include "usb_hid_keys.h"
+#include "xram_map.h"
+
+// Canvas pixel format is BGR555: b in bits 11-15, g in 6-10, r in 0-4
+// (bit 5 is the alpha bit, see colors.h)
+#define COLOR_FROM_RGB8(r,g,b) ((((b)>>3)<<11)|(((g)>>3)<<6)|((r)>>3))
+#define COLOR_R5(c) ((c) & 0x1F)
+#define COLOR_G5(c) (((c) >> 6) & 0x1F)
+#define COLOR_B5(c) ((c) >> 11)
+
+// Light intensities are 8-bit fixed point, 255 = 1.0
+#define INTENSITY_ONE 255
+#define AMBIENT_INTENSITY 26 // 0.1
+#define BACKGROUND_COLOR COLOR_FROM_RGB8(50, 50, 50)
 // XRAM locations
-#define KEYBOARD_INPUT 0xFF10 // KEYBOARD_BYTES of bitmask data
+#define KEYBOARD_BYTES 32
+uint16_t keyboardInput; // XRAM address of KEYBOARD_BYTES of bitmask data
+
+// 1: after the first frame, fly the camera with the keyboard until ESC
+// 0: render one still frame and wait for a key
+#define CAMERA_ANIMATION 1
+
+// Nonzero: render the first frame progressively within this many ms,
+// refining edges first when a full pass doesn't fit
+#define FRAME_BUDGET_MS 0
+
+// 2 or 4: render the first frame interleaved in that many passes, see
+// render_scene_interleaved(); 0: progressively
+#define INTERLEAVED_PASSES 0
+
+// 1: the scene comes from a scene description, with its intersection and
+// shadow code generated by tools/scenec.py (see CMakeLists.txt); the scene
+// is fixed and the light can't be moved
+#ifndef SCENE_COMPILED
+#define SCENE_COMPILED 0
+#endif
+
+// 0: no main(), for the host tools in host/ that drive the tracer themselves
+#ifndef RAYTRACER_MAIN
+#define RAYTRACER_MAIN 1
+#endif
+
+// State of the ray being traced. The host renderer (host/hostrender.c)
+// traces tiles from several threads, each with its own copy.
+#ifdef __mos__
+#define PER_THREAD
+#else
+#define PER_THREAD _Thread_local
+#endif
 
 #define SCREEN_WIDTH 240 
 #define SCREEN_HEIGHT 124 
 // Window size
-#define WIDTH 120
-#define HEIGHT 120
+// Largest traced resolution, sizes the row buffers
+#define MAX_WIDTH 160
+#define MAX_HEIGHT 160
+
+// Render window on the canvas, see init_render_window()
+uint16_t windowWidth = 120;
+uint16_t windowHeight = 120;
+
+// Canvas pixels per traced pixel (1, 2 or 4) and the traced resolution
+uint8_t renderScale = 1;
+int traceWidth = 120;
+int traceHeight = 120;
+
+// Viewport in front of the camera
+#define VIEWPORT_WIDTH 2.0f
+#define VIEWPORT_DIST 1.0f
+float viewportHeight = 2.0f;
 
 // Structs for basic math and objects
 typedef struct {
@@ -46,15 +108,39 @@ typedef struct {
 
 typedef struct {
     Vector3 origin, direction;
+    Vector3 invDirection; // 1 / direction, see ray_inverse()
+    uint8_t signs;        // bit per axis (x, y, z) set where direction is negative
+    bool hasInverse;      // invDirection and signs are filled in
 } Ray;
 
+typedef struct {
+    Vector3 position; // for directional lights: direction towards the light
+    uint8_t intensity; // 8-bit fixed point, 255 = 1.0
+    bool directional;
+} Light;
+
+typedef struct {
+    Vector3 position;
+    Vector3 right, up, forward;
+    float cosYaw, sinYaw;     // yaw around the world y axis
+    float cosPitch, sinPitch; // pitch around the camera right axis
+} Camera;
+
 typedef struct {
     float t;
     Vector3 point;
     Vector3 normal;
-    Sphere* sphere;
+    uint16_t color; // material of the object hit
+    bool reflects;
+    uint8_t object; // scene object index: spheres first, then boxes
 } HitInfo;
 
+#define MAX_LIGHTS 4
+
+#if SCENE_COMPILED
+// Scene objects and lights from the scene description
+#include "scene_data.h"
+#else
 // Scene Objects
 Sphere spheres[] = {
     {{-1.2f, 0.3f, 2.0f}, 0.6f, COLOR_FROM_RGB8(95, 50, 50), true}, // Red Sphere
@@ -68,34 +154,113 @@ Box boxes[] = {
 };
 const int boxCount = sizeof(boxes) / sizeof(Box);
 
-// Light position
-Vector3 lightPos = {-2.0f, 1.0f, -2.0f};
+// Lights
+Light lights[] = {
+    {{-2.0f, 1.0f, -2.0f}, INTENSITY_ONE, false}, // Key light
+    {{0.3f, 1.0f, -0.2f}, 64, true}               // Sky fill (directional)
+};
+const int lightCount = sizeof(lights) / sizeof(Light);
+#endif // SCENE_COMPILED
+
+// Camera, looking down +z
+Camera camera = {
+    {0.0f, 0.0f, -0.50f},
+    {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+    1.0f, 0.0f, 1.0f, 0.0f
+};
+
+// Shadow rays traced per shaded point. The brightest contributing lights
+// get real shadow rays, and one more goes to the other lights in turn; the
+// rest reuse the last result traced for them, so the cost stays bounded as
+// lights are added.
+#define SHADOW_RAY_BUDGET 1
+
+// Objects are numbered spheres first, then boxes
+#define MAX_OBJECTS 8
+#define NO_OBJECT 0x0F // background; fits in a nibble with MAX_OBJECTS
+#define SHADOW_BOUNDS_SLACK 0.01f // added to every bounding radius, see object_bounds()
+_Static_assert(sizeof(spheres) / sizeof(Sphere) + sizeof(boxes) / sizeof(Box) <= MAX_OBJECTS,
+               "more scene objects than MAX_OBJECTS");
+_Static_assert(sizeof(lights) / sizeof(Light) <= MAX_LIGHTS, "more lights than MAX_LIGHTS");
+
+#if !SCENE_COMPILED
+// Shadow caster lists, built by update_shadow_casters().
+// For every light and object this holds the objects that could possibly
+// block that light, so shadow rays only test those. A compiled scene has
+// them built into its generated in_shadow().
+uint8_t shadowCasters[MAX_LIGHTS][MAX_OBJECTS][MAX_OBJECTS];
+uint8_t shadowCasterCount[MAX_LIGHTS][MAX_OBJECTS];
+
+// Copy of the scene the lists were built for, to detect moves
+bool shadowCastersValid = false;
+Light shadowLights[sizeof(lights) / sizeof(Light)];
+Sphere shadowSpheres[sizeof(spheres) / sizeof(Sphere)];
+Box shadowBoxes[sizeof(boxes) / sizeof(Box)];
+#endif
+
+// Last shadow result per light, used to estimate lights over budget
+typedef struct {
+    uint8_t object;
+    bool inShadow;
+} ShadowCache;
+PER_THREAD ShadowCache shadowCache[MAX_LIGHTS];
+PER_THREAD uint8_t shadowTurn; // next light over budget to get a shadow ray
+
+// Start the estimates over, at the start of a pass or of any run of pixels
+// that doesn't follow on from the last one traced
+void reset_shadow_cache() {
+    for (int l = 0; l < MAX_LIGHTS; l++) {
+        shadowCache[l].object = NO_OBJECT;
+        shadowCache[l].inShadow = false;
+    }
+    shadowTurn = 0;
+}
+
+// Channel-scale table: shadeLUT[i][c] = c * i / 31 for a 5-bit channel c and
+// a 5-bit intensity level i, so shading needs no int<->float conversions
+uint8_t shadeLUT[32][32];
+
+void init_shade_lut() {
+    for (uint8_t i = 0; i < 32; i++) {
+        for (uint8_t c = 0; c < 32; c++) {
+            shadeLUT[i][c] = (uint8_t)(((uint16_t)c * i + 15) / 31);
+        }
+    }
+}
+
+// Scale a canvas color by an 8-bit intensity, repacked straight to BGR555
+uint16_t shade_color(uint16_t color, uint8_t intensity) {
+    const uint8_t* scale = shadeLUT[intensity >> 3];
+    return ((uint16_t)scale[COLOR_B5(color)] << 11) |
+           ((uint16_t)scale[COLOR_G5(color)] << 6) |
+           scale[COLOR_R5(color)];
+}
 
-void extractRGB(uint16_t color, uint8_t *r, uint8_t *g, uint8_t *b) {
-    // Extract 5-bit red value
-    uint8_t red5 = (color & 0x1F);
-    // Extract 6-bit green value
-    uint8_t green6 = (color >> 5) & 0x3F;
-    // Extract 5-bit blue value
-    uint8_t blue5 = (color >> 11) & 0x1F;
+// Per-channel (a + b) / 2 of two BGR555 colors without unpacking them
+uint16_t blend_half(uint16_t a, uint16_t b) {
+    return ((a >> 1) & 0x7BCF) + ((b >> 1) & 0x7BCF) + (a & b & 0x0841);
+}
 
-    // Convert to 8-bit values (optional)
-    *r = (red5 << 3) | (red5 >> 2); // Scale 5-bit to 8-bit
-    *g = (green6 << 2) | (green6 >> 4); // Scale 6-bit to 8-bit
-    *b = (blue5 << 3) | (blue5 >> 2); // Scale 5-bit to 8-bit
+// Convert a [0, 1] float factor to an 8-bit intensity, negatives clamp to 0
+uint8_t to_intensity(float f) {
+    if (f <= 0.0f) return 0;
+    if (f >= 1.0f) return INTENSITY_ONE;
+    return (uint8_t)(f * INTENSITY_ONE);
 }
 
 
 float Q_rsqrt(float number) {
-    long i;
+    union {
+        float f;
+        int32_t i; // long is 64 bits on most hosts
+    } bits;
     float x2, y;
     const float threehalfs = 1.5F;
 
     x2 = number * 0.5F;
-    y = number;
-    i = *(long *)&y;                       // Bit-level hack to get integer representation
-    i = 0x5f3759df - (i >> 1);             // Magic constant and bit manipulation
-    y = *(float *)&i;                      // Convert back to float
+    bits.f = number;                       // Bit-level hack to get integer representation
+    bits.i = 0x5f3759df - (bits.i >> 1);   // Magic constant and bit manipulation
+    y = bits.f;                            // Convert back to float
     y = y * (threehalfs - (x2 * y * y));   // One iteration of Newton's method
     // y = y * (threehalfs - (x2 * y * y)); // Uncomment for more iterations (improves accuracy)
 
@@ -106,7 +271,16 @@ float my_sqrtf(float number) {
     return number * Q_rsqrt(number);
 }
 
-float fabs(float x) {
+// Two Newton iterations, for the scene-compile passes where the error of
+// my_sqrtf would be scaled up by the size of the ground sphere
+float precise_sqrtf(float number) {
+    float y = Q_rsqrt(number);
+    y = y * (1.5F - (number * 0.5F * y * y));
+    return number * y;
+}
+
+// Not fabs(), which math.h declares for doubles on the host
+float my_fabsf(float x) {
     // If x is negative, return its negation, otherwise return x as is.
     return (x < 0.0f) ? -x : x;
 }
@@ -114,8 +288,8 @@ float fabs(float x) {
 
 void WaitForAnyKey(){
 
-    xregn(0, 0, 0, 1, KEYBOARD_INPUT);
-    RIA.addr0 = KEYBOARD_INPUT;
+    xregn(0, 0, 0, 1, keyboardInput);
+    RIA.addr0 = keyboardInput;
     RIA.step0 = 0;
     while (RIA.rw0 & 1)
         ;
@@ -132,208 +306,897 @@ Vector3 vector_normalize(Vector3 v) {
     return vector_scale(v, 1.0f / len);
 }
 
-// Ray-sphere intersection
-bool ray_sphere_intersect(Ray* ray, Sphere* sphere, HitInfo* hit) {
-    Vector3 oc = vector_sub(ray->origin, sphere->center);
-    float a = vector_dot(ray->direction, ray->direction);
-    float b = 2.0f * vector_dot(oc, ray->direction);
-    float c = vector_dot(oc, oc) - sphere->radius * sphere->radius;
-    float discriminant = b * b - 4 * a * c;
-
-    if (discriminant > 0) {
-        float t = (-b - my_sqrtf(discriminant)) / (2.0f * a);
-        if (t > 0) {
-            hit->t = t;
-            hit->point = vector_add(ray->origin, vector_scale(ray->direction, t));
-            hit->normal = vector_normalize(vector_sub(hit->point, sphere->center));
-            hit->sphere = sphere;
-            return true;
+// Pointer versions for the per-ray code. Passing and returning Vector3 by
+// value copies 12 bytes through the soft stack on every call; these write
+// to an out parameter instead, which may be one of the inputs.
+static inline void vec_add(Vector3* out, const Vector3* a, const Vector3* b) {
+    out->x = a->x + b->x;
+    out->y = a->y + b->y;
+    out->z = a->z + b->z;
+}
+
+static inline void vec_sub(Vector3* out, const Vector3* a, const Vector3* b) {
+    out->x = a->x - b->x;
+    out->y = a->y - b->y;
+    out->z = a->z - b->z;
+}
+
+static inline void vec_scale(Vector3* out, const Vector3* v, float s) {
+    out->x = v->x * s;
+    out->y = v->y * s;
+    out->z = v->z * s;
+}
+
+// out = a + b * s
+static inline void vec_madd(Vector3* out, const Vector3* a, const Vector3* b, float s) {
+    out->x = a->x + b->x * s;
+    out->y = a->y + b->y * s;
+    out->z = a->z + b->z * s;
+}
+
+static inline float vec_dot(const Vector3* a, const Vector3* b) {
+    return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+static inline void vec_normalize(Vector3* v) {
+    vec_scale(v, v, 1.0f / my_sqrtf(vec_dot(v, v)));
+}
+
+// Rebuild the camera basis from its yaw and pitch
+void camera_update_basis() {
+    camera.forward = (Vector3){camera.sinYaw * camera.cosPitch, camera.sinPitch, camera.cosYaw * camera.cosPitch};
+    camera.right = (Vector3){camera.cosYaw, 0.0f, -camera.sinYaw};
+    camera.up = (Vector3){-camera.sinYaw * camera.sinPitch, camera.cosPitch, -camera.cosYaw * camera.sinPitch};
+}
+
+// Put the camera at (x, y, z), turned to a yaw and pitch given as (cos, sin)
+void set_camera(float x, float y, float z, float cosYaw, float sinYaw, float cosPitch, float sinPitch) {
+    camera.position = (Vector3){x, y, z};
+    camera.cosYaw = cosYaw;
+    camera.sinYaw = sinYaw;
+    camera.cosPitch = cosPitch;
+    camera.sinPitch = sinPitch;
+    camera_update_basis();
+}
+
+// Add a step angle to an angle kept as (cos, sin), renormalized so that
+// repeated steps don't drift
+void rotate_angle(float* c, float* s, float stepCos, float stepSin) {
+    float nc = *c * stepCos - *s * stepSin;
+    float ns = *s * stepCos + *c * stepSin;
+    float len = precise_sqrtf(nc * nc + ns * ns);
+    *c = nc / len;
+    *s = ns / len;
+}
+
+// Primary ray through viewport coordinates (u, v)
+void camera_ray(float u, float v, Ray* ray) {
+    vec_scale(&ray->direction, &camera.right, u);
+    vec_madd(&ray->direction, &ray->direction, &camera.up, v);
+    vec_madd(&ray->direction, &ray->direction, &camera.forward, VIEWPORT_DIST);
+    vec_normalize(&ray->direction);
+    ray->origin = camera.position;
+    ray->hasInverse = false;
+}
+
+// Bounding sphere of a scene object (spheres first, then boxes)
+void object_bounds(int object, Vector3* center, float* radius) {
+    if (object < sphereCount) {
+        *center = spheres[object].center;
+        *radius = spheres[object].radius;
+    } else {
+        Box* box = &boxes[object - sphereCount];
+        Vector3 half = vector_scale(vector_sub(box->max, box->min), 0.5f);
+        *center = vector_add(box->min, half);
+        *radius = precise_sqrtf(vector_dot(half, half));
+    }
+    *radius += SHADOW_BOUNDS_SLACK;
+}
+
+#if !SCENE_COMPILED
+// Conservative test whether the occluder bound (oc, occR) can cut any
+// segment between the light and a point inside the receiver bound (rc, recR).
+bool may_occlude(Light* light, Vector3 oc, float occR, Vector3 rc, float recR) {
+    if (light->directional) {
+        // Receiver bound swept towards the light is a half-cylinder
+        Vector3 dir = vector_normalize(light->position);
+        Vector3 rel = vector_sub(oc, rc);
+        float along = vector_dot(rel, dir);
+        if (along < -(occR + recR)) return false;
+        Vector3 perp = vector_sub(rel, vector_scale(dir, along));
+        float reach = occR + recR;
+        return vector_dot(perp, perp) < reach * reach;
+    }
+
+    Vector3 toOcc = vector_sub(oc, light->position);
+    Vector3 toRec = vector_sub(rc, light->position);
+    float dOcc = precise_sqrtf(vector_dot(toOcc, toOcc));
+    float dRec = precise_sqrtf(vector_dot(toRec, toRec));
+
+    // Light inside one of the bounds, anything goes
+    if (dOcc <= occR || dRec <= recR) return true;
+
+    // Occluder lies entirely behind the receiver
+    if (dOcc - occR >= dRec + recR) return false;
+
+    // Plane tangent to the occluder, facing the light, separates it from
+    // the receiver (this is what culls the huge ground sphere)
+    Vector3 n = vector_scale(toOcc, -1.0f / dOcc);
+    if (vector_dot(vector_sub(rc, oc), n) - occR >= recR) return false;
+
+    // Light-space cones: the occluder must overlap the cone from the light
+    // to the receiver, i.e. angle between axes < sum of half-angles
+    float cosAxes = vector_dot(toOcc, toRec) / (dOcc * dRec);
+    float sinR = recR / dRec, sinO = occR / dOcc;
+    float cosSum = precise_sqrtf(1.0f - sinR * sinR) * precise_sqrtf(1.0f - sinO * sinO) - sinR * sinO;
+    return cosAxes > cosSum;
+}
+
+// Scene-compile pass for shadows, rebuilt whenever the light or an object
+// has moved since the last build
+void update_shadow_casters() {
+    if (shadowCastersValid &&
+        memcmp(shadowLights, lights, sizeof(lights)) == 0 &&
+        memcmp(shadowSpheres, spheres, sizeof(spheres)) == 0 &&
+        memcmp(shadowBoxes, boxes, sizeof(boxes)) == 0) {
+        return;
+    }
+
+    int objectCount = sphereCount + boxCount;
+    for (int l = 0; l < lightCount; l++) {
+        for (int r = 0; r < objectCount; r++) {
+            Vector3 rc, oc;
+            float recR, occR;
+            object_bounds(r, &rc, &recR);
+            shadowCasterCount[l][r] = 0;
+            for (int o = 0; o < objectCount; o++) {
+                // Convex objects never shadow themselves
+                if (o == r) continue;
+                object_bounds(o, &oc, &occR);
+                if (may_occlude(&lights[l], oc, occR, rc, recR)) {
+                    shadowCasters[l][r][shadowCasterCount[l][r]++] = o;
+                }
+            }
+        }
+    }
+    reset_shadow_cache();
+
+    memcpy(shadowLights, lights, sizeof(lights));
+    memcpy(shadowSpheres, spheres, sizeof(spheres));
+    memcpy(shadowBoxes, boxes, sizeof(boxes));
+    shadowCastersValid = true;
+}
+#endif // !SCENE_COMPILED
+
+// Primary ray footprints, built by update_row_spans().
+// For every traced half row (y = 0, 0.5, 1, ...) and object this holds the
+// first and last pixel x whose primary ray can meet the object's bounding
+// sphere, so trace_ray only tests objects that cover the pixel. Boxes use
+// their bounding sphere too. Samples off the half rows test everything.
+#define ALL_OBJECTS 0xFF
+#define OBJECT_COUNT (int)(sizeof(spheres) / sizeof(Sphere) + sizeof(boxes) / sizeof(Box))
+uint8_t rowSpans[MAX_HEIGHT * 2][OBJECT_COUNT][2];
+
+// Camera, resolution and scene the spans were built for
+bool rowSpansValid = false;
+Camera spanCamera;
+int spanWidth, spanHeight;
+Sphere spanSpheres[sizeof(spheres) / sizeof(Sphere)];
+Box spanBoxes[sizeof(boxes) / sizeof(Box)];
+
+// Pixel x range of the row at viewport height v where the primary ray can
+// meet the sphere (center, radius). Along the row the unnormalised ray
+// direction is d0 + u * right, and the discriminant of the ray against the
+// sphere is a quadratic in u that is only >= 0 between its two roots. The
+// range is padded by a pixel each way for rounding.
+void solve_row_span(float v, const Vector3* center, float radius, uint8_t* span) {
+    Vector3 d0, l;
+    vec_scale(&d0, &camera.up, v);
+    vec_madd(&d0, &d0, &camera.forward, VIEWPORT_DIST);
+    vec_sub(&l, center, &camera.position);
+    float k = vec_dot(&l, &l) - radius * radius;
+    float p = vec_dot(&l, &d0);
+    float q = vec_dot(&l, &camera.right);
+    float a = q * q - k;
+    float b = p * q;
+    float c = p * p - k * vec_dot(&d0, &d0);
+    float first = 0.0f;
+    float last = traceWidth - 1;
+
+    // Camera outside the sphere and the roots bound a closed range;
+    // otherwise the whole row is kept
+    if (k > 0.0f && a < 0.0f) {
+        float disc = b * b - a * c;
+        if (disc < 0.0f) {
+            span[0] = 1;
+            span[1] = 0;
+            return;
+        }
+        float root = precise_sqrtf(disc);
+        float u0 = (-b + root) / a;
+        float u1 = (-b - root) / a;
+        // Sphere behind the camera along the whole range
+        if (p + u0 * q <= 0.0f && p + u1 * q <= 0.0f) {
+            span[0] = 1;
+            span[1] = 0;
+            return;
+        }
+        first = u0 * traceWidth / VIEWPORT_WIDTH + traceWidth / 2.0f - 1.0f;
+        last = u1 * traceWidth / VIEWPORT_WIDTH + traceWidth / 2.0f + 1.0f;
+    }
+
+    if (last < 0.0f || first > traceWidth - 1) {
+        span[0] = 1;
+        span[1] = 0;
+        return;
+    }
+    span[0] = (first < 0.0f) ? 0 : (uint8_t)first;
+    span[1] = (last > traceWidth - 1) ? traceWidth - 1 : (uint8_t)last;
+}
+
+// Scene-compile pass for primary rays, rebuilt whenever the camera, the
+// traced resolution or an object has changed since the last build
+void update_row_spans() {
+    if (rowSpansValid && spanWidth == traceWidth && spanHeight == traceHeight &&
+        memcmp(&spanCamera, &camera, sizeof(camera)) == 0 &&
+        memcmp(spanSpheres, spheres, sizeof(spheres)) == 0 &&
+        memcmp(spanBoxes, boxes, sizeof(boxes)) == 0) {
+        return;
+    }
+
+    for (int o = 0; o < OBJECT_COUNT; o++) {
+        Vector3 center;
+        float radius;
+        object_bounds(o, &center, &radius);
+        for (int row = 0; row < traceHeight * 2; row++) {
+            float v = -(row * 0.5f - traceHeight / 2.0f) * viewportHeight / traceHeight;
+            solve_row_span(v, &center, radius, rowSpans[row][o]);
+        }
+    }
+
+    spanCamera = camera;
+    spanWidth = traceWidth;
+    spanHeight = traceHeight;
+    memcpy(spanSpheres, spheres, sizeof(spheres));
+    memcpy(spanBoxes, boxes, sizeof(boxes));
+    rowSpansValid = true;
+}
+
+// Objects (bit per object) whose footprint covers the sample at window
+// position (x, y)
+uint8_t primary_candidates(float x, float y) {
+    float half = y * 2.0f;
+    int row = (int)half;
+    if (!rowSpansValid || row != half) {
+        return ALL_OBJECTS;
+    }
+
+    uint8_t px = (uint8_t)x;
+    uint8_t candidates = 0;
+    uint8_t bit = 1;
+    for (int o = 0; o < OBJECT_COUNT; o++, bit <<= 1) {
+        if (px >= rowSpans[row][o][0] && px <= rowSpans[row][o][1]) {
+            candidates |= bit;
         }
     }
+    return candidates;
+}
+
+// Scanline mode: when a row is traced left to right, each sphere's
+// discriminant (the quadratic in u from solve_row_span) and p = L . d are
+// forward differenced from sample to sample for the unnormalised ray
+// direction d, so deciding a miss costs a few additions and a hit is solved
+// from them without the dot products of ray_sphere_intersect. The values
+// drift a little with each addition: a sample is only a miss once the
+// discriminant is below -slop, and samples near the silhouette, where the
+// root is sensitive to that drift, use the exact test.
+#define SCANLINE_SLOP 1e-4f // of the largest term of the quadratic
+#define SCANLINE_EDGE 64.0f // slops of discriminant below which the exact test runs
+
+typedef struct {
+    float disc, delta, delta2; // discriminant at the next sample and its differences
+    float p, pStep;            // L . d at the next sample and its difference
+    float k;                   // |L|^2 - r^2, <= 0 when the camera is inside
+    float slop;                // 1e30 sends every sample to the exact test
+} ScanlineSphere;
+ScanlineSphere scanlineSpheres[sizeof(spheres) / sizeof(Sphere)];
+
+// Length of the unnormalised direction of the current scanline sample,
+// 0 outside scanline mode
+float scanlineLength = 0.0f;
+
+// Set up the differences for samples x0, x0 + step, ... of window row y
+void begin_scanline(float x0, float y, float step) {
+    float v = -(y - traceHeight / 2.0f) * viewportHeight / traceHeight;
+    float u0 = (x0 - traceWidth / 2.0f) * VIEWPORT_WIDTH / traceWidth;
+    float du = step * VIEWPORT_WIDTH / traceWidth;
+    float uMax = VIEWPORT_WIDTH / 2.0f + my_fabsf(du);
+    Vector3 d0;
+    vec_scale(&d0, &camera.up, v);
+    vec_madd(&d0, &d0, &camera.forward, VIEWPORT_DIST);
+
+    for (int i = 0; i < sphereCount; i++) {
+        ScanlineSphere* scan = &scanlineSpheres[i];
+        Vector3 l;
+        vec_sub(&l, &spheres[i].center, &camera.position);
+        float p = vec_dot(&l, &d0);
+        float q = vec_dot(&l, &camera.right);
+        scan->k = vec_dot(&l, &l) - spheres[i].radius * spheres[i].radius;
+        if (scan->k <= 0.0f) {
+            // Camera inside: always left to the exact test. A slop this
+            // large keeps the sphere a candidate and fails the silhouette
+            // check of scanline_sphere_distance() on every sample.
+            scan->disc = 0.0f;
+            scan->delta = scan->delta2 = 0.0f;
+            scan->slop = 1e30f;
+            continue;
+        }
+        float a = q * q - scan->k;
+        float b = p * q;
+        float c = p * p - scan->k * vec_dot(&d0, &d0);
+        scan->disc = (a * u0 + 2.0f * b) * u0 + c;
+        scan->delta = a * (2.0f * u0 * du + du * du) + 2.0f * b * du;
+        scan->delta2 = 2.0f * a * du * du;
+        scan->p = p + q * u0;
+        scan->pStep = q * du;
+        scan->slop = SCANLINE_SLOP * (my_fabsf(a) * uMax * uMax + 2.0f * my_fabsf(b) * uMax + my_fabsf(c));
+    }
+}
+
+// Objects that can be hit by the current scanline sample
+uint8_t scanline_candidates() {
+    uint8_t candidates = ALL_OBJECTS;
+    uint8_t bit = 1;
+    for (int i = 0; i < sphereCount; i++, bit <<= 1) {
+        if (scanlineSpheres[i].disc < -scanlineSpheres[i].slop) {
+            candidates &= ~bit;
+        }
+    }
+    return candidates;
+}
+
+// Move the differences on to the next sample
+void scanline_step() {
+    for (int i = 0; i < sphereCount; i++) {
+        ScanlineSphere* scan = &scanlineSpheres[i];
+        scan->disc += scan->delta;
+        scan->delta += scan->delta2;
+        scan->p += scan->pStep;
+    }
+}
+
+// Fill in a sphere hit at distance t along the ray
+void sphere_hit(Ray* ray, Sphere* sphere, float t, HitInfo* hit) {
+    hit->t = t;
+    vec_madd(&hit->point, &ray->origin, &ray->direction, t);
+    vec_sub(&hit->normal, &hit->point, &sphere->center);
+    vec_normalize(&hit->normal);
+    hit->color = sphere->color;
+    hit->reflects = sphere->reflects;
+    hit->object = sphere - spheres;
+}
+
+// Distance along the ray to the sphere, when it's hit in front of the origin.
+// The near root is c / q with q = -(b + sign(b) sqrt(disc)) (b halved here),
+// not (-b - sqrt(disc)) / a, which cancels when sqrt(disc) is close to -b: on
+// the ground sphere that is every ray. Only b < 0 can have a near root in
+// front, so sign(b) is always -1.
+bool sphere_distance(Ray* ray, Sphere* sphere, float* t) {
+    STATS_INC(sphereTests);
+    Vector3 oc;
+    vec_sub(&oc, &ray->origin, &sphere->center);
+    float a = vec_dot(&ray->direction, &ray->direction);
+    float b = vec_dot(&oc, &ray->direction);
+    float c = vec_dot(&oc, &oc) - sphere->radius * sphere->radius;
+    float discriminant = b * b - a * c;
+
+    if (discriminant > 0 && b < 0) {
+        *t = c / (my_sqrtf(discriminant) - b);
+        return *t > 0;
+    }
     return false;
 }
 
-Vector3 box_normal(Vector3 point, Box* box) {
-    Vector3 normal = {0.0f, 0.0f, 0.0f};
-    if ( fabs(point.x - box->min.x) < FLT_EPSILON) normal.x = -1.0f;
-    else if (fabs(point.x - box->max.x) < FLT_EPSILON) normal.x = 1.0f;
-    else if (fabs(point.y - box->min.y) < FLT_EPSILON) normal.y = -1.0f;
-    else if (fabs(point.y - box->max.y) < FLT_EPSILON) normal.y = 1.0f;
-    else if (fabs(point.z - box->min.z) < FLT_EPSILON) normal.z = -1.0f;
-    else if (fabs(point.z - box->max.z) < FLT_EPSILON) normal.z = 1.0f;
-    return vector_normalize(normal);
+// Ray-sphere intersection
+bool ray_sphere_intersect(Ray* ray, Sphere* sphere, HitInfo* hit) {
+    float t;
+    if (!sphere_distance(ray, sphere, &t)) {
+        return false;
+    }
+    sphere_hit(ray, sphere, t, hit);
+    return true;
 }
 
-bool ray_box_intersect(Ray* ray, Box* box, HitInfo* hit) {
-    Vector3 invDir = vector_scale(ray->direction, -1.0f);
-    invDir.x = 1.0f / invDir.x;
-    invDir.y = 1.0f / invDir.y;
-    invDir.z = 1.0f / invDir.z;
+// Primary ray of the current scanline sample against sphere i, solved from
+// the forward differences. The near root k / (p + sqrt(disc)), in units of
+// the unnormalised direction, is the same cancellation-free form as
+// sphere_distance() uses. Hits only when the sphere is in front, p > 0.
+bool scanline_sphere_distance(Ray* ray, int i, float* t) {
+    ScanlineSphere* scan = &scanlineSpheres[i];
+    if (scan->disc < SCANLINE_EDGE * scan->slop) {
+        return sphere_distance(ray, &spheres[i], t);
+    }
+    if (scan->p <= 0.0f) {
+        return false;
+    }
+    *t = scan->k / (scan->p + my_sqrtf(scan->disc)) * scanlineLength;
+    return true;
+}
 
-    float tmin = (box->min.x - ray->origin.x) * invDir.x;
-    float tmax = (box->max.x - ray->origin.x) * invDir.x;
-    if (tmin > tmax) { float temp = tmin; tmin = tmax; tmax = temp; }
+// Reciprocal direction and direction signs for the slab test, worked out
+// on a ray's first box test and shared by every box after that
+void ray_inverse(Ray* ray) {
+    ray->invDirection.x = 1.0f / ray->direction.x;
+    ray->invDirection.y = 1.0f / ray->direction.y;
+    ray->invDirection.z = 1.0f / ray->direction.z;
+    ray->signs = ((ray->direction.x < 0.0f) ? 1 : 0) |
+                 ((ray->direction.y < 0.0f) ? 2 : 0) |
+                 ((ray->direction.z < 0.0f) ? 4 : 0);
+    ray->hasInverse = true;
+}
 
-    float tymin = (box->min.y - ray->origin.y) * invDir.y;
-    float tymax = (box->max.y - ray->origin.y) * invDir.y;
-    if (tymin > tymax) { float temp = tymin; tymin = tymax; tymax = temp; }
+// Ray-box intersection with slabs. The near and far planes of each slab
+// are picked by the direction signs, so no swaps are needed, and the slab
+// that sets the entry (or exit) distance is the face that was hit. A ray
+// starting inside the box hits the face it leaves through. Either way the
+// normal faces back along the ray.
+bool box_distance(Ray* ray, Box* box, float* t, uint8_t* axis) {
+    STATS_INC(boxTests);
+    if (!ray->hasInverse) {
+        ray_inverse(ray);
+    }
+    uint8_t signs = ray->signs;
+    uint8_t entryAxis = 0;
+    uint8_t exitAxis = 0;
+
+    float tmin = (((signs & 1) ? box->max.x : box->min.x) - ray->origin.x) * ray->invDirection.x;
+    float tmax = (((signs & 1) ? box->min.x : box->max.x) - ray->origin.x) * ray->invDirection.x;
+
+    float tymin = (((signs & 2) ? box->max.y : box->min.y) - ray->origin.y) * ray->invDirection.y;
+    float tymax = (((signs & 2) ? box->min.y : box->max.y) - ray->origin.y) * ray->invDirection.y;
 
     if ((tmin > tymax) || (tymin > tmax)) return false;
 
-    if (tymin > tmin) tmin = tymin;
-    if (tymax < tmax) tmax = tymax;
+    if (tymin > tmin) { tmin = tymin; entryAxis = 1; }
+    if (tymax < tmax) { tmax = tymax; exitAxis = 1; }
 
-    float tzmin = (box->min.z - ray->origin.z) * invDir.z;
-    float tzmax = (box->max.z - ray->origin.z) * invDir.z;
-    if (tzmin > tzmax) { float temp = tzmin; tzmin = tzmax; tzmax = temp; }
+    float tzmin = (((signs & 4) ? box->max.z : box->min.z) - ray->origin.z) * ray->invDirection.z;
+    float tzmax = (((signs & 4) ? box->min.z : box->max.z) - ray->origin.z) * ray->invDirection.z;
 
     if ((tmin > tzmax) || (tzmin > tmax)) return false;
 
-    if (tzmin > tmin) tmin = tzmin;
-    if (tzmax < tmax) tmax = tzmax;
+    if (tzmin > tmin) { tmin = tzmin; entryAxis = 2; }
+    if (tzmax < tmax) { tmax = tzmax; exitAxis = 2; }
 
     if (tmax < 0.0f) return false; // Box is behind the ray
 
-    hit->t = tmin;
-    hit->point = vector_add(ray->origin, vector_scale(ray->direction, tmin));
-    hit->normal = box_normal(hit->point, box);
-    hit->sphere = box;
+    if (tmin < 0.0f) {
+        // Ray starts inside the box
+        *t = tmax;
+        *axis = exitAxis;
+    } else {
+        *t = tmin;
+        *axis = entryAxis;
+    }
+    return true;
+}
+
+// Fill in a box hit at distance t on the face of the given slab axis
+void box_hit(Ray* ray, Box* box, float t, uint8_t axis, HitInfo* hit) {
+    float facing = (ray->signs & (1 << axis)) ? 1.0f : -1.0f;
+    hit->t = t;
+    vec_madd(&hit->point, &ray->origin, &ray->direction, t);
+    hit->normal = (Vector3){axis == 0 ? facing : 0.0f, axis == 1 ? facing : 0.0f, axis == 2 ? facing : 0.0f};
+    hit->color = box->color;
+    hit->reflects = box->reflects;
+    hit->object = sphereCount + (box - boxes);
+}
 
+// Ray-box intersection
+bool ray_box_intersect(Ray* ray, Box* box, HitInfo* hit) {
+    float t;
+    uint8_t axis;
+    if (!box_distance(ray, box, &t, &axis)) {
+        return false;
+    }
+    box_hit(ray, box, t, axis, hit);
     return true;
-};
+}
 
 
 
-// Scene rendering
-// Updated trace_ray function with single reflection
-uint16_t trace_ray(Ray* ray, int x, int y) {
-    HitInfo hit, closestHit;
-    closestHit.t = 1e30f; // Large value for initial check
-    bool hitAnything = false;
+// Working state of the ray being traced. Tracing isn't reentrant: there is
+// one primary ray in flight, with at most one shadow or reflection ray
+// hanging off it at a time, so instead of living in soft stack frames the
+// hot values sit at fixed addresses. The per-ray fields go in zero page on
+// the 6502, where every access is a short instruction and pointers to them
+// need no copying; the bigger, colder hits and secondary rays in static
+// RAM. Build with the link map (see CMakeLists.txt) to check the placement.
+// llvm-mos's __zeropage keeps an initialiser (.zp.data), which a bare
+// .zp.bss section attribute would drop.
+#ifdef __mos__
+#define ZEROPAGE __zeropage
+#else
+#define ZEROPAGE PER_THREAD
+#endif
 
-    // Find closest hit amont spheres
-    for (int i = 0; i < sphereCount; i++) {
-        if (ray_sphere_intersect(ray, &spheres[i], &hit) && hit.t < closestHit.t) {
-            closestHit = hit;
-            hitAnything = true;
+typedef struct {
+    Ray ray;             // primary ray, see pixel_ray() and trace_scanline_pixel()
+    float closestT;      // distance to the closest hit so far
+    uint8_t closest;     // its object index, NO_OBJECT for none
+    uint8_t closestAxis; // slab axis of the face hit, for boxes
+    float t;             // distance from the object test in progress
+    uint8_t axis;        // and its slab axis, for boxes
+} Tracer;
+
+ZEROPAGE Tracer tracer;
+
+PER_THREAD HitInfo primaryHit;
+PER_THREAD HitInfo reflectionHit;
+PER_THREAD Ray reflectionRay;
+PER_THREAD Ray shadowRay;
+
+#if SCENE_COMPILED
+// The scene's objects, tests and shadow lists are fixed: the functions
+// below are generated for it by tools/scenec.py, with every object's test
+// unrolled and its constants inlined.
+#include "scene_trace.h"
+#else
+// Closest of the objects in candidates (bit per object) hit by the ray,
+// NO_OBJECT for none. closestT comes in as the distance to beat and goes
+// out as the hit's; closestAxis is the slab axis of a box face hit.
+uint8_t closest_object(Ray* ray, uint8_t candidates, float* closestT, uint8_t* closestAxis) {
+    uint8_t closest = NO_OBJECT;
+    uint8_t bit = 1;
+
+    for (int i = 0; i < sphereCount; i++, bit <<= 1) {
+        if ((candidates & bit) &&
+            (scanlineLength ? scanline_sphere_distance(ray, i, &tracer.t)
+                            : sphere_distance(ray, &spheres[i], &tracer.t)) &&
+            tracer.t < *closestT) {
+            *closestT = tracer.t;
+            closest = i;
         }
     }
 
-    // Find closest hit among boxes
-    for (int i = 0; i < boxCount; i++) {
-        if (ray_box_intersect(ray, &boxes[i], &hit) && hit.t < closestHit.t) {
-            closestHit = hit;
-            hitAnything = true;
+    for (int i = 0; i < boxCount; i++, bit <<= 1) {
+        if ((candidates & bit) && box_distance(ray, &boxes[i], &tracer.t, &tracer.axis) &&
+            tracer.t < *closestT) {
+            *closestT = tracer.t;
+            *closestAxis = tracer.axis;
+            closest = sphereCount + i;
         }
     }
+    return closest;
+}
 
-    if (hitAnything) {
-        // Basic Phong shading
-        Vector3 lightDir = vector_normalize(vector_sub(lightPos, closestHit.point));
-        float diffuse = fmaxf(0.0f, vector_dot(closestHit.normal, lightDir));
-        
-        // Shadow check
-        Ray shadowRay = {closestHit.point, lightDir};
-        bool inShadow = false;
-        for (int i = 0; i < sphereCount; i++) {
-            HitInfo shadowHit;
-            if (ray_sphere_intersect(&shadowRay, &spheres[i], &shadowHit) && shadowHit.t > 0.001f) {
-                inShadow = true;
-                break;
-            }
+// Fill in the hit of an object found by closest_object()
+void object_hit(Ray* ray, uint8_t object, float t, uint8_t axis, HitInfo* hit) {
+    if (object < sphereCount) {
+        sphere_hit(ray, &spheres[object], t, hit);
+    } else {
+        box_hit(ray, &boxes[object - sphereCount], t, axis, hit);
+    }
+}
+
+// Closest sphere hit by a ray reflected off the object. The object itself
+// is skipped: a ray can't go back into a convex object it starts on.
+uint8_t reflection_object(Ray* ray, uint8_t object, float* closestT) {
+    uint8_t closest = NO_OBJECT;
+
+    for (int i = 0; i < sphereCount; i++) {
+        if (i != object && sphere_distance(ray, &spheres[i], &tracer.t) && tracer.t < *closestT) {
+            *closestT = tracer.t;
+            closest = i;
         }
-        for (int i = 0; i < boxCount; i++) {
-            HitInfo shadowHit;
-            if (ray_box_intersect(&shadowRay, &boxes[i], &shadowHit) && shadowHit.t > 0.001f) {
-                inShadow = true;
-                break;
-            }
+    }
+    return closest;
+}
+
+// Shadow ray against the objects that can block this light from the object
+bool in_shadow(Ray* ray, uint8_t light, uint8_t object) {
+    uint8_t casterCount = shadowCasterCount[light][object];
+    for (int i = 0; i < casterCount; i++) {
+        uint8_t o = shadowCasters[light][object][i];
+        bool blocked = (o < sphereCount)
+            ? sphere_distance(ray, &spheres[o], &tracer.t)
+            : box_distance(ray, &boxes[o - sphereCount], &tracer.t, &tracer.axis);
+        if (blocked && tracer.t > 0.001f) {
+            return true;
         }
+    }
+    return false;
+}
+#endif // SCENE_COMPILED
+
+// Direction from a point towards a light
+void light_direction(Light* light, const Vector3* point, Vector3* dir) {
+    if (light->directional) {
+        *dir = light->position;
+    } else {
+        vec_sub(dir, &light->position, point);
+    }
+    vec_normalize(dir);
+}
+
+// Total light intensity at a hit, accumulated in 8-bit fixed point.
+// With castShadows, up to SHADOW_RAY_BUDGET of the brightest contributors
+// trace shadow rays, then one of the others in turn; the rest are estimated
+// from the last shadow ray traced for them.
+uint8_t light_intensity(HitInfo* hit, bool castShadows) {
+    static PER_THREAD Vector3 dirs[MAX_LIGHTS];
+    static PER_THREAD uint8_t contrib[MAX_LIGHTS];
+    uint16_t total = 0;
+
+    for (int l = 0; l < lightCount; l++) {
+        light_direction(&lights[l], &hit->point, &dirs[l]);
+        uint8_t diffuse = to_intensity(vec_dot(&hit->normal, &dirs[l]));
+        contrib[l] = ((uint16_t)diffuse * lights[l].intensity) / INTENSITY_ONE;
+    }
 
-        // Calculate the base color (direct lighting)
-        uint16_t sphereColor = closestHit.sphere->color;
-        uint8_t r, g, b;
-        extractRGB(sphereColor, &r, &g, &b);
-        // printf("Extracted RGB: (%u, %u, %u)\n", r, g, b);
-        int baseR = r * (inShadow ? 0.1f : diffuse);
-        int baseG = g * (inShadow ? 0.1f : diffuse);
-        int baseB = b * (inShadow ? 0.1f : diffuse);
-
-        // If the sphere is the red sphere, add reflection
-        if (closestHit.sphere->reflects) { // Use the new field to check for reflections
-            // Calculate the reflection ray
-            Vector3 viewDir = vector_scale(ray->direction, -1.0f);
-            float dot = vector_dot(viewDir, closestHit.normal);
-            Vector3 reflectionDir = vector_sub(
-                vector_scale(closestHit.normal, 2.0f * dot), viewDir);
-            reflectionDir = vector_normalize(reflectionDir);
-
-            Ray reflectionRay = {vector_add(closestHit.point, vector_scale(reflectionDir, 0.001f)), reflectionDir};
-            HitInfo reflectionHit;
-            reflectionHit.t = 1e30f;
-            bool reflectionHitAnything = false;
-
-            // Find closest hit for the reflection ray
-            for (int i = 0; i < sphereCount; i++) {
-                if (ray_sphere_intersect(&reflectionRay, &spheres[i], &hit) && hit.t < reflectionHit.t) {
-                    reflectionHit = hit;
-                    reflectionHitAnything = true;
+    if (castShadows) {
+        uint8_t traced = 0; // bit per light
+        for (int budget = 0; budget <= SHADOW_RAY_BUDGET; budget++) {
+            int next = -1;
+            if (budget < SHADOW_RAY_BUDGET) {
+                for (int l = 0; l < lightCount; l++) {
+                    if (contrib[l] && !(traced & (1 << l)) &&
+                        (next < 0 || contrib[l] > contrib[next])) {
+                        next = l;
+                    }
+                }
+            } else {
+                // The round-robin ray, so a light that is never the
+                // brightest still gets its shadow traced now and then
+                for (int n = 0; n < lightCount && next < 0; n++) {
+                    int l = (shadowTurn + n) % lightCount;
+                    if (contrib[l] && !(traced & (1 << l))) {
+                        next = l;
+                        shadowTurn = l + 1;
+                    }
                 }
             }
-
-            // Calculate reflection color
-            int reflectR = 0, reflectG = 0, reflectB = 0;
-            if (reflectionHitAnything) {
-                uint16_t reflectionColor = reflectionHit.sphere->color;
-                extractRGB(reflectionColor, &r, &g, &b);
-                float reflectDiffuse = fmaxf(0.0f, vector_dot(vector_normalize(vector_sub(lightPos, reflectionHit.point)), reflectionHit.normal));
-                reflectR = r * reflectDiffuse;
-                reflectG = g * reflectDiffuse;
-                reflectB = b * reflectDiffuse;
+            if (next < 0) break;
+            shadowRay.origin = hit->point;
+            shadowRay.direction = dirs[next];
+            shadowRay.hasInverse = false;
+            STATS_INC(shadowRays);
+            traced |= 1 << next;
+            shadowCache[next].object = hit->object;
+            shadowCache[next].inShadow = in_shadow(&shadowRay, next, hit->object);
+        }
+        for (int l = 0; l < lightCount; l++) {
+            // Traced, or over budget: reuse the last result if it was on the
+            // same object
+            if (contrib[l] && shadowCache[l].object == hit->object &&
+                shadowCache[l].inShadow) {
+                contrib[l] = 0;
             }
+        }
+    }
+
+    for (int l = 0; l < lightCount; l++) {
+        total += contrib[l];
+    }
+    if (total < AMBIENT_INTENSITY) return AMBIENT_INTENSITY;
+    if (total > INTENSITY_ONE) return INTENSITY_ONE;
+    return total;
+}
 
-            // Blend the base color with the reflection color (50% contribution)
-            baseR = (baseR + reflectR) / 2;
-            baseG = (baseG + reflectG) / 2;
-            baseB = (baseB + reflectB) / 2;
+// Object hit by the last primary ray traced, NO_OBJECT for background
+ZEROPAGE uint8_t traceObject = NO_OBJECT;
+
+// Shade primaryHit, the hit of tracer.ray: Basic Phong shading with
+// shadows, lights summed in fixed point, plus a single reflection
+uint16_t shade_hit() {
+    Ray* ray = &tracer.ray;
+    HitInfo* closestHit = &primaryHit;
+    uint16_t baseColor = shade_color(closestHit->color,
+                                     light_intensity(closestHit, true));
+
+    // If the sphere is the red sphere, add reflection
+    if (closestHit->reflects) { // Use the new field to check for reflections
+        // Calculate the reflection ray: the direction mirrored about the
+        // normal, nudged off the surface
+        float dot = -vec_dot(&ray->direction, &closestHit->normal);
+        vec_scale(&reflectionRay.direction, &closestHit->normal, 2.0f * dot);
+        vec_add(&reflectionRay.direction, &reflectionRay.direction, &ray->direction);
+        vec_normalize(&reflectionRay.direction);
+        vec_madd(&reflectionRay.origin, &closestHit->point, &reflectionRay.direction, 0.001f);
+        reflectionRay.hasInverse = false;
+        STATS_INC(reflectionRays);
+
+        // Find closest hit for the reflection ray. The primary ray's closest
+        // hit is settled, so its slots are reused.
+        tracer.closestT = 1e30f;
+        tracer.closest = reflection_object(&reflectionRay, closestHit->object, &tracer.closestT);
+
+        // Calculate reflection color
+        uint16_t reflectColor = 0;
+        if (tracer.closest != NO_OBJECT) {
+            object_hit(&reflectionRay, tracer.closest, tracer.closestT, 0, &reflectionHit);
+            reflectColor = shade_color(reflectionHit.color,
+                                       light_intensity(&reflectionHit, false));
         }
 
-        // Clamp the color values to 0-255
-        // baseR = min(max(baseR, 0), 255);
-        // baseG = min(max(baseG, 0), 255);
-        // baseB = min(max(baseB, 0), 255);
+        // Blend the base color with the reflection color (50% contribution)
+        baseColor = blend_half(baseColor, reflectColor);
+    }
+
+    return baseColor;
+}
 
-        return COLOR_FROM_RGB8(baseR, baseG, baseB);
+// Scene rendering
+// Updated trace_ray function with single reflection: traces tracer.ray.
+// Only the objects in candidates (bit per object, see primary_candidates)
+// are tested. The search only tracks the closest distance; the hit point
+// and normal are filled in once, for the object that wins.
+uint16_t trace_ray(uint8_t candidates) {
+    STATS_INC(primaryRays);
+
+    tracer.closestT = 1e30f; // Large value for initial check
+    tracer.closest = closest_object(&tracer.ray, candidates, &tracer.closestT, &tracer.closestAxis);
+    traceObject = tracer.closest;
+
+    if (traceObject != NO_OBJECT) {
+        object_hit(&tracer.ray, traceObject, tracer.closestT, tracer.closestAxis, &primaryHit);
+        STATS_INC(hits);
+        return shade_hit();
     }
 
     // Background color
-    return COLOR_FROM_RGB8(50, 50, 50);
+    return BACKGROUND_COLOR;
 }
 
+// G-buffer: the object hit by each traced pixel of the last full
+// resolution progressive pass, two pixels per byte in spare XRAM. Moving a
+// light can then be relit by intersecting only the stored object. The point
+// and normal come from that one exact intersection, so no t or normal has to
+// be stored. At 16bpp the canvas leaves room for render scale 2 and 4 only.
+uint16_t gbuffer = XRAM_NULL;
+uint16_t gbufferBytes;
+bool gbufferValid; // stored objects match the camera and render scale
+
+// Reserve the G-buffer for the finest render scale whose traced pixels fit
+void init_gbuffer() {
+    uint16_t room = xram_largest_free();
+    for (uint8_t scale = 1; scale <= 4; scale <<= 1) {
+        uint16_t bytes = ((windowWidth / scale) * (windowHeight / scale) + 1) / 2;
+        if (bytes <= room) {
+            gbuffer = xram_reserve("g-buffer", bytes, 1);
+            gbufferBytes = bytes;
+            printf("G-buffer: scale %u and up\n", scale);
+            return;
+        }
+    }
+    printf("G-buffer: no room in XRAM\n");
+}
+
+bool gbuffer_fits() {
+    return gbuffer != XRAM_NULL && ((traceWidth * traceHeight + 1) / 2) <= gbufferBytes;
+}
+
+void gbuffer_store(int x, int y, uint8_t object) {
+    uint16_t i = y * traceWidth + x;
+    uint8_t shift = (i & 1) << 2;
+    RIA.addr1 = gbuffer + (i >> 1);
+    RIA.step1 = 0;
+    RIA.rw1 = (RIA.rw1 & ~(0x0F << shift)) | (object << shift);
+}
+
+uint8_t gbuffer_object(int x, int y) {
+    uint16_t i = y * traceWidth + x;
+    RIA.addr1 = gbuffer + (i >> 1);
+    return (RIA.rw1 >> ((i & 1) << 2)) & 0x0F;
+}
+
+// Fit the render window to the canvas init_bitmap_graphics actually gave
+// us: a square on the left, leaving the right part for the progress bar and
+// stats, a multiple of 4 so every render scale divides it
+void init_render_window() {
+    uint16_t size = canvas_width() / 2;
+    if (size > canvas_height()) size = canvas_height();
+    if (size > MAX_WIDTH) size = MAX_WIDTH;
+    if (size > MAX_HEIGHT) size = MAX_HEIGHT;
+    windowWidth = windowHeight = size & ~3;
+}
+
+// Traced resolution, keeping square pixels. The row buffers and spans only
+// cover MAX_WIDTH x MAX_HEIGHT; the host renderer goes past that with
+// trace_pixel() and no row spans.
+void set_trace_size(int width, int height) {
+    traceWidth = width;
+    traceHeight = height;
+    viewportHeight = VIEWPORT_WIDTH * traceHeight / traceWidth;
+}
+
+// Trace at 1/scale of the window resolution (scale 1, 2 or 4)
+void set_render_scale(uint8_t scale) {
+    renderScale = scale;
+    gbufferValid = false;
+    set_trace_size(windowWidth / scale, windowHeight / scale);
+}
+
+// XRAM address of the start of window row y (in canvas pixels), 16bpp
+uint16_t window_row_address(uint16_t y) {
+    return canvas_address() + (canvas_width() << 1) * y;
+}
+
+// Queue a block of traced pixels, doubled up to canvas pixels. Traced
+// output goes through the draw queue so neighbouring blocks and runs of
+// pixels of the same color reach the canvas as single spans; every render
+// function flushes it before returning.
+void put_block(uint16_t color, int x, int y, int w, int h) {
+    queue_fill_rect(color, x * renderScale, y * renderScale, w * renderScale, h * renderScale);
+}
+
+void put_pixel(uint16_t color, int x, int y) {
+    if (renderScale == 1) {
+        queue_pixel(color, x, y);
+    } else {
+        put_block(color, x, y, 1, 1);
+    }
+}
+
+// Primary ray through window position (x, y), in pixels
+void pixel_ray(float x, float y, Ray* ray) {
+    float u = (x - traceWidth / 2.0f) * VIEWPORT_WIDTH / traceWidth;
+    float v = -(y - traceHeight / 2.0f) * viewportHeight / traceHeight;
+    camera_ray(u, v, ray);
+}
+
+// Trace the primary ray through window position (x, y), in pixels
+uint16_t trace_pixel(float x, float y) {
+    pixel_ray(x, y, &tracer.ray);
+    return trace_ray(primary_candidates(x, y));
+}
+
+// Trace the next sample of the row set up by begin_scanline(). The ray is
+// built as camera_ray does, keeping the direction's length for the
+// scanline solve.
+uint16_t trace_scanline_pixel(float x, float y) {
+    Ray* ray = &tracer.ray;
+    float u = (x - traceWidth / 2.0f) * VIEWPORT_WIDTH / traceWidth;
+    float v = -(y - traceHeight / 2.0f) * viewportHeight / traceHeight;
+    vec_scale(&ray->direction, &camera.right, u);
+    vec_madd(&ray->direction, &ray->direction, &camera.up, v);
+    vec_madd(&ray->direction, &ray->direction, &camera.forward, VIEWPORT_DIST);
+    scanlineLength = my_sqrtf(vec_dot(&ray->direction, &ray->direction));
+    vec_scale(&ray->direction, &ray->direction, 1.0f / scanlineLength);
+    ray->origin = camera.position;
+    ray->hasInverse = false;
+
+    uint16_t color = trace_ray(primary_candidates(x, y) & scanline_candidates());
+    scanlineLength = 0.0f;
+    scanline_step();
+    return color;
+}
 
 // Main drawing function
 void render_scene() {
-    Vector3 cameraPos = {0.0f, 0.0f, -0.50f};
-    float viewportWidth = 2.0f;
-    float viewportHeight = 2.0f * HEIGHT / WIDTH;
-    float viewportDist = 1.0f;
-
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-			
-            float u = (x - WIDTH / 2.0f) * viewportWidth / WIDTH;
-            float v = -(y - HEIGHT / 2.0f) * viewportHeight / HEIGHT;
-            Vector3 rayDir = vector_normalize((Vector3){u, v, viewportDist});
-            Ray ray = {cameraPos, rayDir};
-            uint16_t color = trace_ray(&ray, x, y);
-            draw_pixel(color, x, y);
+#if !SCENE_COMPILED
+    update_shadow_casters();
+#endif
+    update_row_spans();
+    stats_begin_pass();
+    reset_shadow_cache();
+
+    for (int y = 0; y < traceHeight; y++) {
+        begin_scanline(0, y, 1);
+        for (int x = 0; x < traceWidth; x++) {
+            uint16_t color = trace_scanline_pixel(x, y);
+            put_pixel(color, x, y);
         }
     }
+    flush_draw_queue();
+
+    stats_end_pass();
 }
 
 // Progressive rendering parameters
 #define INITIAL_BLOCK_SIZE 20 // Start with 8x8 blocks, can be adjusted
 #define PROGRESS_BAR_WIDTH 2 // Width of the progress bar in pixels
+#define STATS_X (windowWidth + 10) // Stats overlay, right of the progress bar
 
 uint8_t blockSizes[] = {20, 8, 4, 1};
 uint16_t colors[] = {COLOR_FROM_RGB8(200, 0, 0), 
@@ -349,79 +1212,790 @@ uint16_t get_progress_bar_color(int step) {
 }
 
 void draw_progress_bar(int currentProgress, int totalProgress, uint16_t color) {
-    float progressLength = (float)((float)(currentProgress * WIDTH) / totalProgress); // Calculate the width of the progress bar
+    float progressLength = (float)((float)(currentProgress * windowHeight) / totalProgress); // Calculate the width of the progress bar
     // printf("len: %i\n", progressLength);
     // Draw the progress bar at the bottom of the screen
-    fill_rect(color, WIDTH + 5, 0, PROGRESS_BAR_WIDTH, (uint16_t)progressLength);
+    fill_rect(color, windowWidth + 5, 0, PROGRESS_BAR_WIDTH, (uint16_t)progressLength);
 }
 
-void render_scene_progressive() {
-    Vector3 cameraPos = {0.0f, 0.0f, -0.50f};
-    float viewportWidth = 2.0f;
-    float viewportHeight = 2.0f * HEIGHT / WIDTH;
-    float viewportDist = 1.0f;
+// Clear the render window and the progress bar next to it, leaving the
+// stats overlay alone
+void clear_render_window(uint16_t color) {
+    flush_draw_queue();
+    fill_rect(color, 0, 0, windowWidth + 5 + PROGRESS_BAR_WIDTH, windowHeight);
+}
+
+// Object hit at each (even, even) traced pixel, nibble packed. The
+// progressive passes keep the hit at each block centre here so the next pass
+// can find silhouettes; the interleaved passes keep their grid samples.
+uint8_t gridObject[MAX_HEIGHT / 2][MAX_WIDTH / 4];
 
-    int stepIndex = 0; // To track the current step and change the progress bar color
+uint8_t grid_object(int x, int y) {
+    return (gridObject[y >> 1][x >> 2] >> ((x & 2) << 1)) & 0x0F;
+}
+
+void set_grid_object(int x, int y, uint8_t object) {
+    uint8_t shift = (x & 2) << 1;
+    uint8_t* cell = &gridObject[y >> 1][x >> 2];
+    *cell = (*cell & ~(0x0F << shift)) | (object << shift);
+}
+
+// Trace the central pixel of the progressive block at (x, y) and fill the
+// block with it. The outline that shows where we are is drawn straight to
+// the canvas, the fill is queued: anything that reads the canvas back has
+// to flush the queue first, or it can see the outline.
+void refine_block(int x, int y, uint8_t blockSize, uint16_t outlineColor) {
+    // Blocks are clipped at the window edge for sizes that don't divide it
+    int w = (x + blockSize <= traceWidth) ? blockSize : traceWidth - x;
+    int h = (y + blockSize <= traceHeight) ? blockSize : traceHeight - y;
+
+    // A single pixel's outline would be the pixel itself
+    if (blockSize > 1) {
+        draw_rect(outlineColor, x * renderScale, y * renderScale, w * renderScale, h * renderScale); // show where we are on the screen
+    }
+
+    // Trace the ray for the central pixel of the block
+    uint16_t color = trace_pixel(x + w / 2.0f, y + h / 2.0f);
+    set_grid_object((x + w / 2) & ~1, (y + h / 2) & ~1, traceObject);
+    if (blockSize == 1 && gbuffer_fits()) {
+        gbuffer_store(x, y, traceObject);
+    }
+
+    // Fill the current block with the calculated color
+    put_block(color, x, y, w, h);
+}
+
+// Refinement priority: blocks of a pass are ranked by how much the previous
+// pass changes around them, so silhouettes and shadow edges are refined
+// before flat areas. The top REFINE_QUEUE_SIZE blocks are kept in a static
+// min-heap while the pass is scanned, refined in descending priority, and
+// the rest of the pass then follows in scan order.
+#define REFINE_QUEUE_SIZE 128
+#define EDGE_THRESHOLD 4     // summed 5-bit channel difference that marks an edge
+#define OBJECT_EDGE_BONUS 32 // added when neighbouring samples hit different objects
+
+typedef struct {
+    uint16_t order; // priority while ranking, then scan position
+    uint8_t x, y;
+} RefineEntry;
+
+RefineEntry refineQueue[REFINE_QUEUE_SIZE];
+uint8_t refineCount;
+
+// Restore the min-heap below slot i
+void refine_sift_down(uint8_t i, uint8_t count) {
+    RefineEntry e = refineQueue[i];
+    for (;;) {
+        uint8_t child = 2 * i + 1;
+        if (child >= count) break;
+        if (child + 1 < count && refineQueue[child + 1].order < refineQueue[child].order) child++;
+        if (refineQueue[child].order >= e.order) break;
+        refineQueue[i] = refineQueue[child];
+        i = child;
+    }
+    refineQueue[i] = e;
+}
+
+// Keep the REFINE_QUEUE_SIZE entries with the highest order
+void refine_push(uint16_t order, uint8_t x, uint8_t y) {
+    if (refineCount < REFINE_QUEUE_SIZE) {
+        // Sift up
+        uint8_t i = refineCount++;
+        while (i > 0 && refineQueue[(i - 1) / 2].order > order) {
+            refineQueue[i] = refineQueue[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        refineQueue[i].order = order;
+        refineQueue[i].x = x;
+        refineQueue[i].y = y;
+    } else if (order > refineQueue[0].order) {
+        refineQueue[0].order = order;
+        refineQueue[0].x = x;
+        refineQueue[0].y = y;
+        refine_sift_down(0, refineCount);
+    }
+}
+
+// Heapsort the queue into descending order
+void refine_sort() {
+    for (uint8_t n = refineCount; n > 1; n--) {
+        RefineEntry top = refineQueue[0];
+        refineQueue[0] = refineQueue[n - 1];
+        refineQueue[n - 1] = top;
+        refine_sift_down(0, n - 1);
+    }
+}
+
+// Read back traced pixel (x, y) from the canvas
+uint16_t read_traced_pixel(int x, int y) {
+    RIA.addr0 = window_row_address(y * renderScale) + ((x * renderScale) << 1);
+    RIA.step0 = 1;
+    uint16_t lo = RIA.rw0;
+    return lo | ((uint16_t)RIA.rw0 << 8);
+}
+
+uint8_t color_distance(uint16_t a, uint16_t b) {
+    int8_t r = COLOR_R5(a) - COLOR_R5(b);
+    int8_t g = COLOR_G5(a) - COLOR_G5(b);
+    int8_t bl = COLOR_B5(a) - COLOR_B5(b);
+    return (r < 0 ? -r : r) + (g < 0 ? -g : g) + (bl < 0 ? -bl : bl);
+}
+
+// Object hit at the centre of the previous pass's block covering (x, y)
+uint8_t previous_object(int x, int y, uint8_t prevSize) {
+    int bx = x - x % prevSize;
+    int by = y - y % prevSize;
+    int w = (bx + prevSize <= traceWidth) ? prevSize : traceWidth - bx;
+    int h = (by + prevSize <= traceHeight) ? prevSize : traceHeight - by;
+    return grid_object((bx + w / 2) & ~1, (by + h / 2) & ~1);
+}
+
+// Compare the block centre with one neighbouring block centre
+uint8_t neighbour_step(uint16_t color, uint8_t object, int x, int y, uint8_t prevSize) {
+    uint8_t step = color_distance(color, read_traced_pixel(x, y));
+    if (previous_object(x, y, prevSize) != object) {
+        step += OBJECT_EDGE_BONUS;
+    }
+    return step;
+}
+
+// Largest step between the centre of the block at (x, y) and the centres of
+// its four neighbours, as left by the previous pass
+uint8_t block_priority(int x, int y, uint8_t blockSize, uint8_t prevSize) {
+    int cx = x + blockSize / 2;
+    int cy = y + blockSize / 2;
+    if (cx >= traceWidth) cx = traceWidth - 1;
+    if (cy >= traceHeight) cy = traceHeight - 1;
+    uint16_t color = read_traced_pixel(cx, cy);
+    uint8_t object = previous_object(cx, cy, prevSize);
+    uint8_t priority = 0;
+    uint8_t d;
+    if (cx >= blockSize && (d = neighbour_step(color, object, cx - blockSize, cy, prevSize)) > priority) priority = d;
+    if (cx + blockSize < traceWidth && (d = neighbour_step(color, object, cx + blockSize, cy, prevSize)) > priority) priority = d;
+    if (cy >= blockSize && (d = neighbour_step(color, object, cx, cy - blockSize, prevSize)) > priority) priority = d;
+    if (cy + blockSize < traceHeight && (d = neighbour_step(color, object, cx, cy + blockSize, prevSize)) > priority) priority = d;
+    return priority;
+}
+
+uint32_t elapsed_ms(clock_t start) {
+    return (uint32_t)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+}
+
+// Refine pass i, edges first, until maxRays rays have been traced or
+// budgetMs has passed since start (0: no deadline). With edgesOnly, blocks
+// past the queue are only refined if they are still on an edge. Returns the
+// number of blocks refined.
+uint16_t refine_pass(uint8_t i, uint16_t maxRays, clock_t start, uint16_t budgetMs, bool edgesOnly) {
+    uint8_t blockSize = blockSizes[i];
+    uint16_t outlineColor = get_progress_bar_color(i);
+    uint16_t refined = 0;
+    uint16_t position = 0;
+
+    // The previous pass is read back below
+    flush_draw_queue();
+    reset_shadow_cache();
+    refineCount = 0;
+    if (i > 0) {
+        for (int y = 0; y < traceHeight; y += blockSize) {
+            for (int x = 0; x < traceWidth; x += blockSize) {
+                uint8_t priority = block_priority(x, y, blockSize, blockSizes[i - 1]);
+                if (priority >= EDGE_THRESHOLD) {
+                    refine_push(priority, x, y);
+                }
+            }
+        }
+    }
+    refine_sort();
+
+    for (uint8_t q = 0; q < refineCount; q++) {
+        if (refined >= maxRays || (budgetMs && elapsed_ms(start) >= budgetMs)) {
+            return refined;
+        }
+        refine_block(refineQueue[q].x, refineQueue[q].y, blockSize, outlineColor);
+        refined++;
+    }
+
+    // Rank the queued blocks by scan position, descending positions from
+    // the top so the sort leaves them ascending, to skip them below
+    for (uint8_t q = 0; q < refineCount; q++) {
+        refineQueue[q].order = 0xFFFF - ((refineQueue[q].y / blockSize) * ((traceWidth + blockSize - 1) / blockSize) + refineQueue[q].x / blockSize);
+    }
+    for (uint8_t q = refineCount / 2; q > 0; q--) {
+        refine_sift_down(q - 1, refineCount);
+    }
+    refine_sort();
+
+    uint8_t next = 0;
+    for (int y = 0; y < traceHeight; y += blockSize) {
+        for (int x = 0; x < traceWidth; x += blockSize, position++) {
+            if (next < refineCount && 0xFFFF - refineQueue[next].order == position) {
+                next++;
+                continue;
+            }
+            if (edgesOnly) {
+                // Blocks refined so far are read back as neighbours
+                flush_draw_queue();
+                if (block_priority(x, y, blockSize, blockSizes[i - 1]) < EDGE_THRESHOLD) {
+                    continue;
+                }
+            }
+            if (refined >= maxRays || (budgetMs && elapsed_ms(start) >= budgetMs)) {
+                return refined;
+            }
+            refine_block(x, y, blockSize, outlineColor);
+            refined++;
+        }
+    }
+    return refined;
+}
+
+void render_scene_progressive() {
+#if !SCENE_COMPILED
+    update_shadow_casters();
+#endif
+    update_row_spans();
 
     // Start with a large block size and reduce until we reach single pixel rendering
-    for (int i = 0; i < sizeof(blockSizes); i++) {
+    for (uint8_t i = 0; i < sizeof(blockSizes); i++) {
+        stats_begin_pass();
+        refine_pass(i, 0xFFFF, 0, 0, false);
+        flush_draw_queue();
+        stats_end_pass();
+    }
+
+    gbufferValid = gbuffer_fits();
+}
+
+// Frame-time governor: the coarse progressive pass is timed to estimate the
+// cost of a ray, and each finer pass only runs if its predicted cost fits in
+// what is left of the budget. When it doesn't, the rays that do fit go to
+// the highest priority blocks and then to any other edge blocks; flat blocks
+// keep their coarse fill.
+uint8_t governorLevel;     // index in blockSizes of the finest complete pass
+uint8_t governorCoverage;  // percent of the next pass's blocks refined
+
+// Progressive render that stops refining once budgetMs is used up. The
+// coarse pass always runs. Returns the time taken in ms; the quality reached
+// is left in governorLevel and governorCoverage.
+uint32_t render_scene_governed(uint16_t budgetMs) {
+    clock_t start = clock();
+    uint32_t spentMs = 0;
+    uint32_t rays = 0;
+
+#if !SCENE_COMPILED
+    update_shadow_casters();
+#endif
+    update_row_spans();
+    governorLevel = 0;
+    governorCoverage = 0;
+    gbufferValid = false;
+
+    for (uint8_t i = 0; i < sizeof(blockSizes); i++) {
         uint8_t blockSize = blockSizes[i];
-        // Calculate the total number of ray traces for the current block size
-        int totalRays = (WIDTH / blockSize) * (HEIGHT / blockSize);
-        int completedRays = 0;
+        uint16_t passRays = ((traceWidth + blockSize - 1) / blockSize) * ((traceHeight + blockSize - 1) / blockSize);
+
+        if (i > 0) {
+            if (spentMs >= budgetMs) {
+                break;
+            }
+            uint32_t remainingMs = budgetMs - spentMs;
+            // Predict from the average cost of every ray so far
+            if ((uint32_t)passRays * spentMs / rays > remainingMs) {
+                stats_begin_pass();
+                uint16_t refined = refine_pass(i, remainingMs * rays / spentMs, start, budgetMs, true);
+                flush_draw_queue();
+                stats_end_pass();
+                governorCoverage = (uint32_t)refined * 100 / passRays;
+                break;
+            }
+        }
+
+        stats_begin_pass();
+        refine_pass(i, 0xFFFF, 0, 0, false);
+        flush_draw_queue();
+        stats_end_pass();
 
-        // Get the progress bar color for the current block size iteration
-        uint16_t progressBarColor = get_progress_bar_color(stepIndex);
-        stepIndex++; // Move to the next color for the next block size
+        rays += passRays;
+        governorLevel = i;
+        spentMs = elapsed_ms(start);
+    }
+
+    gbufferValid = gbuffer_fits() && governorLevel == sizeof(blockSizes) - 1;
+
+    return elapsed_ms(start);
+}
+
+// Window rows are copied through RAM for reprojection and reconstruction
+uint16_t rowBuffer[MAX_WIDTH];
+
+// Read traced row y into rowBuffer, one canvas pixel per traced pixel
+void read_window_row(int y) {
+    flush_draw_queue();
+    STATS_INC(addrSetups);
+    RIA.addr0 = window_row_address(y * renderScale);
+    RIA.step0 = 1;
+    for (int x = 0; x < traceWidth; x++) {
+        uint16_t lo = RIA.rw0;
+        rowBuffer[x] = lo | ((uint16_t)RIA.rw0 << 8);
+        // Skip the doubled-up canvas pixels
+        for (uint8_t i = 1; i < renderScale; i++) {
+            (void)RIA.rw0;
+            (void)RIA.rw0;
+        }
+    }
+}
+
+// Write traced row y, each pixel doubled up renderScale times both ways
+void write_window_row(int y, uint16_t* colors) {
+    flush_draw_queue();
+    for (uint8_t row = 0; row < renderScale; row++) {
+        STATS_INC(addrSetups);
+        STATS_ADD(riaBytes, traceWidth * renderScale * 2);
+        RIA.addr0 = window_row_address(y * renderScale + row);
+        RIA.step0 = 1;
+        for (int x = 0; x < traceWidth; x++) {
+            for (uint8_t i = 0; i < renderScale; i++) {
+                RIA.rw0 = colors[x];
+                RIA.rw0 = colors[x] >> 8;
+            }
+        }
+    }
+}
+
+// Redraw the window from the G-buffer after lights or materials change,
+// tracing only the stored object for each pixel. Pixels whose object is
+// missed at the new sample (none, unless the scene geometry moved) fall back
+// to a full trace.
+void relight_scene() {
+#if !SCENE_COMPILED
+    update_shadow_casters();
+#endif
+    stats_begin_pass();
+    reset_shadow_cache();
+
+    for (int y = 0; y < traceHeight; y++) {
+        for (int x = 0; x < traceWidth; x++) {
+            uint8_t object = gbuffer_object(x, y);
+            if (object == NO_OBJECT) {
+                rowBuffer[x] = BACKGROUND_COLOR;
+                continue;
+            }
 
-        // printf("blockSize: %i\n", blockSize);
+            // Same sample position as the final progressive pass
+            pixel_ray(x + 0.5f, y + 0.5f, &tracer.ray);
+            bool hitObject = (object < sphereCount)
+                ? ray_sphere_intersect(&tracer.ray, &spheres[object], &primaryHit)
+                : ray_box_intersect(&tracer.ray, &boxes[object - sphereCount], &primaryHit);
+            if (hitObject) {
+                traceObject = object;
+                rowBuffer[x] = shade_hit();
+            } else {
+                rowBuffer[x] = trace_ray(ALL_OBJECTS);
+            }
+        }
+        write_window_row(y, rowBuffer);
+    }
+
+    stats_end_pass();
+}
+
+// Interleaved rendering: trace a sparse pattern of pixels per pass and
+// reconstruct the rest from traced neighbours, choosing between the
+// horizontal and vertical neighbour pairs by which pair hit the same object
+// so fills don't bleed across silhouettes. Every pixel is traced by the
+// final pass, so the image ends up exact.
+//   2 passes: checkerboard, then the other half of the checkerboard.
+//   4 passes: (even, even), (odd, odd), (odd, even) and (even, odd) pixels.
+uint16_t ringColor[3][MAX_WIDTH];
+uint8_t ringObject[3][MAX_WIDTH];
+
+// Fill pixel (x, y) from two opposite pairs of neighbours, a pair whose
+// samples hit the same object doesn't straddle an edge
+uint16_t reconstruct(int x, int y,
+                     uint16_t a0, uint8_t ao0, uint16_t a1, uint8_t ao1,
+                     uint16_t b0, uint8_t bo0, uint16_t b1, uint8_t bo1) {
+    bool aSmooth = (ao0 == ao1);
+    bool bSmooth = (bo0 == bo1);
+    if (aSmooth && bSmooth) {
+        if (ao0 == bo0) return blend_half(blend_half(a0, a1), blend_half(b0, b1));
+        // Thin feature: two objects cross here and the samples don't say
+        // which is in front, so trace it. Rare enough to stay cheap.
+        return trace_pixel(x, y);
+    }
+    if (aSmooth) return blend_half(a0, a1);
+    if (bSmooth) return blend_half(b0, b1);
+    // No pair agrees, take any sample whose object is seen twice
+    if (ao0 == bo0 || ao0 == bo1) return a0;
+    if (ao1 == bo0 || ao1 == bo1) return a1;
+    return a0;
+}
 
-        // Iterate over the screen in blocks of current blockSize
-        for (int y = 0; y < HEIGHT; y += blockSize) {
-            for (int x = 0; x < WIDTH; x += blockSize) {
+// Fill from one pair of neighbours, never blending across an edge
+uint16_t pair_fill(uint16_t c0, uint8_t o0, uint16_t c1, uint8_t o1) {
+    return (o0 == o1) ? blend_half(c0, c1) : c0;
+}
 
-                // Calculate the central position of the block for ray tracing
-                float u = ((x + blockSize / 2.0f) - WIDTH / 2.0f) * viewportWidth / WIDTH;
-                float v = -((y + blockSize / 2.0f) - HEIGHT / 2.0f) * viewportHeight / HEIGHT;
+void trace_into_ring(int slot, int x, int y) {
+    ringColor[slot][x] = trace_pixel(x, y);
+    ringObject[slot][x] = traceObject;
+}
 
-                draw_rect(progressBarColor, x, y, blockSize, blockSize); // show where we are on the screen
+// Fill the (x + y) odd pixels of a ring row from the checkerboard samples
+// around it. Missing neighbours at the window border mirror the other side.
+void fill_checkerboard_row(int y) {
+    int mid = y % 3;
+    int up = (y > 0) ? (y - 1) % 3 : (y + 1) % 3;
+    int down = (y < traceHeight - 1) ? (y + 1) % 3 : up;
+
+    for (int x = (y + 1) & 1; x < traceWidth; x += 2) {
+        int left = (x > 0) ? x - 1 : x + 1;
+        int right = (x < traceWidth - 1) ? x + 1 : x - 1;
+        ringColor[mid][x] = reconstruct(x, y,
+            ringColor[mid][left], ringObject[mid][left],
+            ringColor[mid][right], ringObject[mid][right],
+            ringColor[up][x], ringObject[up][x],
+            ringColor[down][x], ringObject[down][x]);
+    }
+}
 
-                Vector3 rayDir = vector_normalize((Vector3){u, v, viewportDist});
-                Ray ray = {cameraPos, rayDir};
-                
-                // Trace the ray for the central pixel of the block
-                uint16_t color = trace_ray(&ray, x + blockSize / 2, y + blockSize / 2);
+// Pass over the checkerboard (x + y even). With traceAll every sample is
+// traced. Otherwise the (even, even) samples already exist in XRAM and
+// gridObject and only the (odd, odd) ones are traced.
+void checkerboard_pass(bool traceAll) {
+    reset_shadow_cache();
+    for (int y = 0; y <= traceHeight; y++) {
+        if (y < traceHeight) {
+            int slot = y % 3;
+            if (traceAll) {
+                for (int x = y & 1; x < traceWidth; x += 2) {
+                    trace_into_ring(slot, x, y);
+                }
+            } else if (y & 1) {
+                for (int x = 1; x < traceWidth; x += 2) {
+                    trace_into_ring(slot, x, y);
+                }
+            } else {
+                read_window_row(y);
+                for (int x = 0; x < traceWidth; x += 2) {
+                    ringColor[slot][x] = rowBuffer[x];
+                    ringObject[slot][x] = grid_object(x, y);
+                }
+            }
+        }
+        // The row above now has both vertical neighbours
+        if (y > 0) {
+            fill_checkerboard_row(y - 1);
+            write_window_row(y - 1, ringColor[(y - 1) % 3]);
+        }
+    }
+}
 
-                // Fill the current block with the calculated color
-                fill_rect(color, x, y, blockSize, blockSize);
+// First of 4 passes: trace the (even, even) grid, fill the rest
+void grid_pass() {
+    int prev = 0, mid = 1, cur = 2;
 
-                // Update progress after each trace_ray call
-                completedRays++;
-                // printf("completedRays: %i, totalRays: %i\n", completedRays, totalRays);
-                // draw_progress_bar(completedRays, totalRays, progressBarColor);
+    reset_shadow_cache();
+    for (int y = 0; y < traceHeight; y += 2) {
+        for (int x = 0; x < traceWidth; x += 2) {
+            trace_into_ring(cur, x, y);
+            set_grid_object(x, y, traceObject);
+        }
+        for (int x = 1; x < traceWidth; x += 2) {
+            int right = (x < traceWidth - 1) ? x + 1 : x - 1;
+            ringColor[cur][x] = pair_fill(ringColor[cur][x - 1], ringObject[cur][x - 1],
+                                          ringColor[cur][right], ringObject[cur][right]);
+        }
+        write_window_row(y, ringColor[cur]);
+
+        // Odd row in between: vertical pairs, or the two diagonals
+        if (y > 0) {
+            for (int x = 0; x < traceWidth; x++) {
+                if (x & 1) {
+                    int right = (x < traceWidth - 1) ? x + 1 : x - 1;
+                    ringColor[mid][x] = reconstruct(x, y - 1,
+                        ringColor[prev][x - 1], ringObject[prev][x - 1],
+                        ringColor[cur][right], ringObject[cur][right],
+                        ringColor[prev][right], ringObject[prev][right],
+                        ringColor[cur][x - 1], ringObject[cur][x - 1]);
+                } else {
+                    ringColor[mid][x] = pair_fill(ringColor[prev][x], ringObject[prev][x],
+                                                  ringColor[cur][x], ringObject[cur][x]);
+                }
             }
+            write_window_row(y - 1, ringColor[mid]);
         }
 
-        // Reset the progress bar when moving to a smaller block size
-        // draw_progress_bar(1, 1, progressBarColor); // Clear the progress bar (black color)
+        int t = prev; prev = cur; cur = t;
+    }
+    // Bottom odd row has nothing below it
+    if (!(traceHeight & 1)) {
+        write_window_row(traceHeight - 1, ringColor[prev]);
     }
 }
 
+// Trace and draw every pixel of one (x0 + 2i, y0 + 2j) pattern exactly
+void exact_pass(int x0, int y0) {
+    reset_shadow_cache();
+    for (int y = y0; y < traceHeight; y += 2) {
+        begin_scanline(x0, y, 2);
+        for (int x = x0; x < traceWidth; x += 2) {
+            put_pixel(trace_scanline_pixel(x, y), x, y);
+        }
+    }
+    flush_draw_queue();
+}
+
+void render_scene_interleaved(uint8_t passes) {
+#if !SCENE_COMPILED
+    update_shadow_casters();
+#endif
+    update_row_spans();
+
+    if (passes == 4) {
+        stats_begin_pass(); grid_pass(); stats_end_pass();
+        stats_begin_pass(); checkerboard_pass(false); stats_end_pass();
+        stats_begin_pass(); exact_pass(1, 0); stats_end_pass();
+        stats_begin_pass(); exact_pass(0, 1); stats_end_pass();
+    } else {
+        stats_begin_pass();
+        checkerboard_pass(true);
+        stats_end_pass();
+
+        stats_begin_pass();
+        reset_shadow_cache();
+        for (int y = 0; y < traceHeight; y++) {
+            begin_scanline((y + 1) & 1, y, 2);
+            for (int x = (y + 1) & 1; x < traceWidth; x += 2) {
+                put_pixel(trace_scanline_pixel(x, y), x, y);
+            }
+        }
+        flush_draw_queue();
+        stats_end_pass();
+    }
+}
+
+// Camera animation with frame-to-frame temporal reuse.
+// Look steps (arrow keys) reproject the previous frame already in XRAM and
+// only trace the strip that became visible. Moves (WASD) can't be reprojected
+// without depth, so they leave the old image up. Either way every pixel is
+// stale afterwards and is re-traced in a rotating 2x2 interleave, a quarter
+// of the window per frame, until the camera rests.
+#define LOOK_SHIFT 4       // pixels the window center moves per look step
+#define MOVE_STEP 0.1f     // camera movement per frame for WASD
+#define REFRESH_PHASES 4   // 2x2 interleave
+#define LIGHT_STEP 0.25f   // light movement per frame for J/L
+
+uint8_t keystates[KEYBOARD_BYTES];
+#define key(code) (keystates[(code) >> 3] & (1 << ((code) & 7)))
+
+int16_t sourceX[MAX_WIDTH];
+#define reprojectRow ringColor[0] // free outside the interleaved passes
+
+void read_keyboard() {
+    STATS_INC(addrSetups);
+    RIA.addr0 = keyboardInput;
+    RIA.step0 = 1;
+    for (int i = 0; i < KEYBOARD_BYTES; i++) {
+        keystates[i] = RIA.rw0;
+    }
+}
+
+// Window x of the pixel a source column maps to, -1 when outside
+int16_t window_x(float x) {
+    if (x < 0.0f || x >= traceWidth) return -1;
+    return (int16_t)x;
+}
+
+// Yaw by angle with tangent t (positive turns right). A viewport point u
+// came from u' = (u + t) / (1 - u t) in the previous frame. The vertical
+// 1 / cos scale is ignored so each row only remaps within itself; the
+// error is at most a few pixels in the corners and the refresh clears it.
+void reproject_yaw(float t) {
+    update_row_spans();
+    reset_shadow_cache();
+    for (int x = 0; x < traceWidth; x++) {
+        float u = (x - traceWidth / 2.0f) * VIEWPORT_WIDTH / traceWidth;
+        float uOld = (u + t) / (1.0f - u * t);
+        sourceX[x] = window_x(uOld * traceWidth / VIEWPORT_WIDTH + traceWidth / 2.0f + 0.5f);
+    }
+
+    for (int y = 0; y < traceHeight; y++) {
+        read_window_row(y);
+        for (int x = 0; x < traceWidth; x++) {
+            // Disoccluded pixels are traced right away
+            reprojectRow[x] = (sourceX[x] >= 0) ? rowBuffer[sourceX[x]] : trace_pixel(x, y);
+        }
+        write_window_row(y, reprojectRow);
+    }
+}
+
+// Pitch by angle with tangent t (positive looks up). A viewport row v came
+// from v' = (v + t) / (1 - v t), scaled horizontally by sqrt(1 + t^2) / (1 - v t).
+// Rows are walked so that a source row is always read before it's overwritten.
+void reproject_pitch(float t) {
+    float secant = precise_sqrtf(1.0f + t * t);
+    update_row_spans();
+    reset_shadow_cache();
+    int y = (t > 0.0f) ? traceHeight - 1 : 0;
+    int dy = (t > 0.0f) ? -1 : 1;
+
+    for (int n = 0; n < traceHeight; n++, y += dy) {
+        float v = -(y - traceHeight / 2.0f) * viewportHeight / traceHeight;
+        float vOld = (v + t) / (1.0f - v * t);
+        float yOld = traceHeight / 2.0f - vOld * traceHeight / viewportHeight + 0.5f;
+        int16_t scale8 = (int16_t)(secant / (1.0f - v * t) * 256.0f + 0.5f);
+        bool rowVisible = (yOld >= 0.0f && yOld < traceHeight);
+
+        if (rowVisible) {
+            read_window_row((int)yOld);
+        }
+        for (int x = 0; x < traceWidth; x++) {
+            int16_t xOld = traceWidth / 2 + (((x - traceWidth / 2) * scale8 + 128) >> 8);
+            reprojectRow[x] = (rowVisible && xOld >= 0 && xOld < traceWidth)
+                ? rowBuffer[xOld] : trace_pixel(x, y);
+        }
+        write_window_row(y, reprojectRow);
+    }
+}
+
+// Re-trace one phase of the 2x2 interleave
+void refresh_interleaved(uint8_t phase) {
+    update_row_spans();
+    reset_shadow_cache();
+    for (int y = phase >> 1; y < traceHeight; y += 2) {
+        begin_scanline(phase & 1, y, 2);
+        for (int x = phase & 1; x < traceWidth; x += 2) {
+            put_pixel(trace_scanline_pixel(x, y), x, y);
+        }
+    }
+    flush_draw_queue();
+}
+
+// Look step whose center shift is LOOK_SHIFT traced pixels
+float stepTan, stepCos, stepSin;
+
+void update_look_step() {
+    stepTan = LOOK_SHIFT * VIEWPORT_WIDTH / traceWidth / VIEWPORT_DIST;
+    stepCos = 1.0f / precise_sqrtf(1.0f + stepTan * stepTan);
+    stepSin = stepTan * stepCos;
+}
+
+void animate_camera() {
+    uint8_t phase = 0;
+    uint8_t staleFrames = 0;
+
+    xregn(0, 0, 0, 1, keyboardInput);
+
+    update_look_step();
+    stats_reset();
+
+    while (true) {
+        read_keyboard();
+        if (key(KEY_ESC)) break;
+
+#if !SCENE_COMPILED
+        update_shadow_casters();
+#endif
+
+        // 1, 2, 3: trace at full, 1/2 or 1/4 resolution, redrawn progressively
+        if (key(KEY_1) || key(KEY_2) || key(KEY_3)) {
+            uint8_t scale = key(KEY_1) ? 1 : key(KEY_2) ? 2 : 4;
+            if (scale != renderScale) {
+                set_render_scale(scale);
+                update_look_step();
+                clear_render_window(BACKGROUND_COLOR);
+                render_scene_progressive();
+                staleFrames = 0;
+            }
+        } else if (key(KEY_LEFT) || key(KEY_RIGHT)) {
+            float dir = key(KEY_RIGHT) ? 1.0f : -1.0f;
+            rotate_angle(&camera.cosYaw, &camera.sinYaw, stepCos, dir * stepSin);
+            camera_update_basis();
+            gbufferValid = false;
+            reproject_yaw(dir * stepTan);
+            staleFrames = REFRESH_PHASES;
+        } else if (key(KEY_UP) || key(KEY_DOWN)) {
+            float dir = key(KEY_UP) ? 1.0f : -1.0f;
+            rotate_angle(&camera.cosPitch, &camera.sinPitch, stepCos, dir * stepSin);
+            camera_update_basis();
+            gbufferValid = false;
+            reproject_pitch(dir * stepTan);
+            staleFrames = REFRESH_PHASES;
+#if !SCENE_COMPILED
+        } else if (key(KEY_J) || key(KEY_L)) {
+            // J, L: move the point light, relit from the G-buffer when it's valid
+            lights[0].position.x += key(KEY_L) ? LIGHT_STEP : -LIGHT_STEP;
+            if (gbufferValid) {
+                relight_scene();
+            } else {
+                render_scene_progressive();
+            }
+            staleFrames = 0;
+            stats_report(STATS_X, 0);
+            stats_reset();
+#endif
+        } else if (key(KEY_W) || key(KEY_S) || key(KEY_A) || key(KEY_D)) {
+            if (key(KEY_W)) camera.position = vector_add(camera.position, vector_scale(camera.forward, MOVE_STEP));
+            if (key(KEY_S)) camera.position = vector_sub(camera.position, vector_scale(camera.forward, MOVE_STEP));
+            if (key(KEY_D)) camera.position = vector_add(camera.position, vector_scale(camera.right, MOVE_STEP));
+            if (key(KEY_A)) camera.position = vector_sub(camera.position, vector_scale(camera.right, MOVE_STEP));
+            gbufferValid = false;
+            staleFrames = REFRESH_PHASES;
+        }
+
+        if (staleFrames) {
+            stats_begin_pass();
+            refresh_interleaved(phase);
+            stats_end_pass();
+            stats_report(STATS_X, 0);
+            stats_reset();
+            phase = (phase + 1) % REFRESH_PHASES;
+            staleFrames--;
+        }
+    }
+}
+
+#if RAYTRACER_MAIN
 int main() {
     
-    init_bitmap_graphics(0xFF00, 0x0000, 0, 2, SCREEN_WIDTH, SCREEN_HEIGHT, 16);
+    if (!init_bitmap_graphics(XRAM_NULL, XRAM_NULL, 0, 2, SCREEN_WIDTH, SCREEN_HEIGHT, 16)) {
+        return 1;
+    }
+    keyboardInput = xram_reserve("keyboard", KEYBOARD_BYTES, 1);
     erase_canvas();
+    init_shade_lut();
+    init_render_window();
+    init_gbuffer();
+    xram_print_map();
+    set_render_scale(1);
+
+    stats_reset();
 
     long startTime = clock();
 
+#if FRAME_BUDGET_MS
+    uint32_t frameMs = render_scene_governed(FRAME_BUDGET_MS);
+    printf("frame: %lu ms, block size %u, %u%% of next pass\n",
+           frameMs, blockSizes[governorLevel], governorCoverage);
+#elif INTERLEAVED_PASSES
+    render_scene_interleaved(INTERLEAVED_PASSES);
+#else
     // render_scene();
     render_scene_progressive();
+#endif
 
     long endTime = clock();
 
-    printf("render took: %lu", (endTime - startTime) / 100);
+    printf("render took: %lu\n", (endTime - startTime) / 100);
+
+    stats_report(STATS_X, 0);
 
+#if CAMERA_ANIMATION
+    animate_camera();
+#else
     WaitForAnyKey();
+#endif
 
     return 0;
 }
+#endif // RAYTRACER_MAIN
@@ -0,0 +1,95 @@
+// ---------------------------------------------------------------------------
+// render_stats.c
+//
+// Per-frame instrumentation for the raytracer, see render_stats.h.
+// ---------------------------------------------------------------------------
+
+#include "render_stats.h"
+
+#if RENDER_STATS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "colors.h"
+#include "bitmap_graphics.h"
+
+RenderStats render_stats;
+
+static clock_t pass_start;
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void stats_reset(void)
+{
+    memset(&render_stats, 0, sizeof(render_stats));
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void stats_begin_pass(void)
+{
+    pass_start = clock();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void stats_end_pass(void)
+{
+    if (render_stats.passCount < STATS_MAX_PASSES) {
+        render_stats.passTicks[render_stats.passCount++] = clock() - pass_start;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// One line on the console and at x, y on the canvas
+// ---------------------------------------------------------------------------
+static void report_line(char * line, uint16_t x, uint16_t y)
+{
+    printf("%s\n", line);
+    set_cursor(x, y);
+    draw_string(line);
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static void report_value(const char * label, uint32_t value, uint16_t x, uint16_t y)
+{
+    char line[24];
+    sprintf(line, "%s %lu", label, (unsigned long)value);
+    report_line(line, x, y);
+}
+
+// ---------------------------------------------------------------------------
+// Draw the counters as text with the top left corner at x, y, and dump them
+// over the console. The values are copied first so the report's own RIA
+// traffic doesn't show up in it.
+// ---------------------------------------------------------------------------
+void stats_report(uint16_t x, uint16_t y)
+{
+    RenderStats s = render_stats;
+    char line[24];
+    uint8_t i;
+
+    set_text_multiplier(1);
+    set_text_colors(color(WHITE, bits_per_pixel() == 16), color(BLACK, bits_per_pixel() == 16));
+    set_text_wrap(false);
+
+    report_value("prim", s.primaryRays,    x, y);
+    report_value("shad", s.shadowRays,     x, y + 8);
+    report_value("refl", s.reflectionRays, x, y + 16);
+    report_value("sph ", s.sphereTests,    x, y + 24);
+    report_value("box ", s.boxTests,       x, y + 32);
+    report_value("hits", s.hits,           x, y + 40);
+    report_value("ria ", s.riaBytes,       x, y + 48);
+    report_value("addr", s.addrSetups,     x, y + 56);
+
+    for (i = 0; i < s.passCount; i++) {
+        sprintf(line, "pass%u %lu.%02lus", i,
+                (unsigned long)(s.passTicks[i] / CLOCKS_PER_SEC),
+                (unsigned long)((s.passTicks[i] % CLOCKS_PER_SEC) * 100 / CLOCKS_PER_SEC));
+        report_line(line, x, y + 64 + i * 8);
+    }
+}
+
+#endif // RENDER_STATS
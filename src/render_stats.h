@@ -0,0 +1,61 @@
+// ---------------------------------------------------------------------------
+// render_stats.h
+//
+// Per-frame instrumentation for the raytracer: ray and intersection test
+// counters, RIA traffic and per-pass timings, shown next to the render
+// window and dumped to the console.
+//
+// Build with RENDER_STATS=1 to enable. When disabled every counter macro
+// expands to nothing and the report functions are empty, so there is no
+// cost in the hot loops.
+// ---------------------------------------------------------------------------
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <stdint.h>
+
+#ifndef RENDER_STATS
+#define RENDER_STATS 0
+#endif
+
+#define STATS_MAX_PASSES 8
+
+typedef struct {
+    uint32_t primaryRays;
+    uint32_t shadowRays;
+    uint32_t reflectionRays;
+    uint32_t sphereTests;
+    uint32_t boxTests;
+    uint32_t hits;
+    uint32_t riaBytes;   // bytes written through the RIA data ports
+    uint32_t addrSetups; // RIA address (re)programs
+    uint32_t passTicks[STATS_MAX_PASSES]; // clock() ticks per render pass
+    uint8_t  passCount;
+} RenderStats;
+
+#if RENDER_STATS
+
+extern RenderStats render_stats;
+
+#define STATS_INC(field)    (render_stats.field++)
+#define STATS_ADD(field, n) (render_stats.field += (n))
+
+void stats_reset(void);
+void stats_begin_pass(void);
+void stats_end_pass(void);
+void stats_report(uint16_t x, uint16_t y);
+
+#else
+
+#define STATS_INC(field)    ((void)0)
+#define STATS_ADD(field, n) ((void)0)
+
+#define stats_reset()        ((void)0)
+#define stats_begin_pass()   ((void)0)
+#define stats_end_pass()     ((void)0)
+#define stats_report(x, y)   ((void)0)
+
+#endif // RENDER_STATS
+
+#endif // RENDER_STATS_H
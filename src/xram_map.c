@@ -0,0 +1,164 @@
+// ---------------------------------------------------------------------------
+// xram_map.c
+//
+// XRAM region bookkeeping, see xram_map.h.
+// ---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "xram_map.h"
+
+// Reserved regions, kept sorted by start address
+static XramRegion regions[XRAM_MAX_REGIONS];
+static uint8_t region_count = 0;
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+static uint32_t region_end(uint8_t i)
+{
+    return (uint32_t)regions[i].start + regions[i].size;
+}
+
+// ---------------------------------------------------------------------------
+// Add a region that is known to fit
+// ---------------------------------------------------------------------------
+static uint16_t insert_region(const char *name, uint16_t start, uint16_t size)
+{
+    uint8_t i = region_count;
+
+    while (i > 0 && regions[i - 1].start > start) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+    regions[i].name = name;
+    regions[i].start = start;
+    regions[i].size = size;
+    region_count++;
+    return start;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void xram_reset(void)
+{
+    region_count = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Reserve size bytes at the lowest free address that is a multiple of align
+// (a power of two). Returns XRAM_NULL if there is no room.
+// ---------------------------------------------------------------------------
+uint16_t xram_reserve(const char *name, uint16_t size, uint16_t align)
+{
+    uint32_t start = 0;
+
+    if (region_count == XRAM_MAX_REGIONS) {
+        printf("XRAM: no region left for %s\n", name);
+        return XRAM_NULL;
+    }
+    if (align == 0) {
+        align = 1;
+    }
+
+    // First fit: try the gap below each region, then the one above the last
+    for (uint8_t i = 0; i <= region_count; i++) {
+        uint32_t end = (i < region_count) ? regions[i].start : 0x10000;
+        start = (start + align - 1) & ~(uint32_t)(align - 1);
+        if (start + size <= end) {
+            return insert_region(name, start, size);
+        }
+        if (i < region_count && region_end(i) > start) {
+            start = region_end(i);
+        }
+    }
+
+    printf("XRAM: no room for %s (%u bytes)\n", name, size);
+    return XRAM_NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Reserve size bytes at a fixed address. Returns XRAM_NULL if the address
+// isn't a multiple of align or the region overlaps one already reserved.
+// ---------------------------------------------------------------------------
+uint16_t xram_reserve_at(const char *name, uint16_t address, uint16_t size, uint16_t align)
+{
+    uint32_t end = (uint32_t)address + size;
+
+    if (align > 1 && (address & (align - 1))) {
+        printf("XRAM: %s at 0x%04X is not %u-byte aligned\n", name, address, align);
+        return XRAM_NULL;
+    }
+    if (end > 0x10000) {
+        printf("XRAM: %s at 0x%04X runs past the end of XRAM\n", name, address);
+        return XRAM_NULL;
+    }
+    if (region_count == XRAM_MAX_REGIONS) {
+        printf("XRAM: no region left for %s\n", name);
+        return XRAM_NULL;
+    }
+    for (uint8_t i = 0; i < region_count; i++) {
+        if (address < region_end(i) && regions[i].start < end) {
+            printf("XRAM: %s at 0x%04X overlaps %s\n", name, address, regions[i].name);
+            return XRAM_NULL;
+        }
+    }
+
+    return insert_region(name, address, size);
+}
+
+// ---------------------------------------------------------------------------
+// Free the region starting at address
+// ---------------------------------------------------------------------------
+void xram_release(uint16_t address)
+{
+    for (uint8_t i = 0; i < region_count; i++) {
+        if (regions[i].start == address) {
+            region_count--;
+            for (; i < region_count; i++) {
+                regions[i] = regions[i + 1];
+            }
+            return;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+uint16_t xram_largest_free(void)
+{
+    uint32_t start = 0;
+    uint32_t largest = 0;
+
+    for (uint8_t i = 0; i <= region_count; i++) {
+        uint32_t end = (i < region_count) ? regions[i].start : 0x10000;
+        if (end > start && end - start > largest) {
+            largest = end - start;
+        }
+        if (i < region_count && region_end(i) > start) {
+            start = region_end(i);
+        }
+    }
+    return (largest > 0xFFFF) ? 0xFFFF : largest;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
+void xram_print_map(void)
+{
+    uint32_t start = 0;
+
+    printf("XRAM map:\n");
+    for (uint8_t i = 0; i <= region_count; i++) {
+        uint32_t end = (i < region_count) ? regions[i].start : 0x10000;
+        if (end > start) {
+            printf("  %04lX-%04lX %5lu free\n", (unsigned long)start, (unsigned long)(end - 1), (unsigned long)(end - start));
+        }
+        if (i < region_count) {
+            if (regions[i].size) {
+                printf("  %04X-%04lX %5u %s\n", regions[i].start, (unsigned long)(region_end(i) - 1), regions[i].size, regions[i].name);
+            }
+            if (region_end(i) > start) {
+                start = region_end(i);
+            }
+        }
+    }
+}
@@ -0,0 +1,31 @@
+// ---------------------------------------------------------------------------
+// xram_map.h
+//
+// Bookkeeping for the 64K of XRAM: every user (canvas data, canvas config
+// struct, palette, keyboard bitmask, scratch buffers) reserves a named
+// region here, either at a fixed address or wherever it fits, so regions
+// can't silently overlap. The map can be printed at startup.
+// ---------------------------------------------------------------------------
+
+#ifndef XRAM_MAP_H
+#define XRAM_MAP_H
+
+#include <stdint.h>
+
+#define XRAM_NULL 0xFFFF  // returned when a region can't be reserved
+#define XRAM_MAX_REGIONS 8
+
+typedef struct {
+    const char *name;
+    uint16_t start;
+    uint16_t size;
+} XramRegion;
+
+void xram_reset(void);
+uint16_t xram_reserve(const char *name, uint16_t size, uint16_t align);
+uint16_t xram_reserve_at(const char *name, uint16_t address, uint16_t size, uint16_t align);
+void xram_release(uint16_t address);
+uint16_t xram_largest_free(void);
+void xram_print_map(void);
+
+#endif // XRAM_MAP_H
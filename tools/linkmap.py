@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: Unlicense
+
+# Report what an llvm-mos (ld.lld) link map put in zero page, and check
+# that the named symbols are in there. The parser follows the ld.lld map
+# format but hasn't been run on a real llvm-mos map yet, so a symbol that
+# isn't found is a warning unless --strict is given.
+#
+#   python3 tools/linkmap.py build/raytracer.map --zp tracer traceObject
+
+import sys
+import re
+import argparse
+
+ZERO_PAGE_END = 0x100
+
+# VMA LMA Size Align, then the Out/In/Symbol column indented 8 per level.
+# ld.lld gives symbol lines a size of 0.
+MAP_LINE = re.compile(r"^\s*([0-9a-fA-F]+)\s+([0-9a-fA-F]+)\s+([0-9a-fA-F]+)\s+(\d+) (.*)$")
+
+
+def read_map(file):
+    """Returns the output sections as (name, addr, size, symbols) with
+    symbols as (name, addr, size, input section)."""
+    sections = []
+    input_section = ""
+    with open(file, "r") as f:
+        for line in f:
+            match = MAP_LINE.match(line.rstrip("\r\n"))
+            if not match:
+                continue
+            addr = int(match.group(1), 16)
+            size = int(match.group(3), 16)
+            rest = match.group(5)
+            name = rest.strip()
+            level = (len(rest) - len(rest.lstrip(" "))) // 8
+            if level == 0:
+                if " = " in name:
+                    continue  # symbol assignment, e.g. the imaginary registers
+                sections.append((name, addr, size, []))
+            elif level == 1:
+                input_section = name
+            elif sections:
+                sections[-1][3].append((name, addr, size, input_section))
+    return sections
+
+
+def exec_args():
+    parser = argparse.ArgumentParser(
+        description="Report the zero page contents of an llvm-mos link map."
+    )
+    parser.add_argument("map", help="Link map written with -Wl,-Map=<file>.")
+    parser.add_argument(
+        "--zp",
+        dest="zp",
+        metavar="symbol",
+        nargs="*",
+        default=[],
+        help="Symbols that should be in zero page.",
+    )
+    parser.add_argument(
+        "--strict",
+        action="store_true",
+        help="Exit 1 if any --zp symbol isn't in zero page.",
+    )
+    args = parser.parse_args()
+
+    sections = read_map(args.map)
+    placed = {}
+    used = 0
+    print(f"[{args.map}] zero page:")
+    for name, addr, size, symbols in sections:
+        for sym, sym_addr, sym_size, _ in symbols:
+            placed[sym] = sym_addr
+        if addr >= ZERO_PAGE_END or size == 0:
+            continue
+        used += size
+        print(f"  ${addr:02X}-${addr + size - 1:02X} {size:3} {name}")
+        for sym, sym_addr, sym_size, _ in symbols:
+            print(f"    ${sym_addr:02X} {sym_size or '':>3} {sym}")
+    print(f"  {used} of {ZERO_PAGE_END} bytes")
+
+    missing = [s for s in args.zp if placed.get(s, ZERO_PAGE_END) >= ZERO_PAGE_END]
+    prefix = "error" if args.strict else "warning"
+    for sym in missing:
+        if sym in placed:
+            print(f"{prefix}: {sym} is at ${placed[sym]:04X}, not in zero page")
+        else:
+            print(f"{prefix}: {sym} is not in the link map")
+    if missing and args.strict:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    exec_args()
@@ -9,6 +9,9 @@
 
 import os
 import re
+import pty
+import tty
+import json
 import time
 import serial
 import binascii
@@ -34,7 +37,8 @@ class Monitor:
     def send_break(self, duration=0.01, retries=1):
         """Stop the 6502 and return to monitor."""
         self.serial.read_all()
-        if platform.system() == "Darwin":
+        if platform.system() == "Darwin" or self.is_pty():
+            # A pty can't carry a break; FakeMonitor takes the NUL as one.
             self.serial.baudrate = 1200
             self.serial.write(b"\0")
             self.serial.baudrate = self.UART_BAUDRATE
@@ -48,6 +52,10 @@ class Monitor:
                 raise te
         self.send_break(duration, retries - 1)
 
+    def is_pty(self):
+        """True for a pseudo terminal, like the one FakeMonitor serves."""
+        return os.path.realpath(self.serial.port).startswith("/dev/pts/")
+
     def command(self, str, timeout=DEFAULT_TIMEOUT):
         """Send one command and wait for next monitor prompt"""
         self.serial.write(bytes(str, "ascii"))
@@ -61,10 +69,14 @@ class Monitor:
 
     def binary(self, addr: int, data):
         """Send data to memory using BINARY command."""
+        self.write_binary(addr, data)
+        self.wait_for_prompt("]")
+
+    def write_binary(self, addr: int, data):
+        """Write a BINARY command and its data without waiting for the prompt."""
         command = f"BINARY ${addr:04X} ${len(data):03X} ${binascii.crc32(data):08X}\r"
         self.serial.write(bytes(command, "utf-8"))
         self.serial.write(data)
-        self.wait_for_prompt("]")
 
     def upload(self, file, name):
         """Upload readable file to remote file "name" """
@@ -84,11 +96,24 @@ class Monitor:
 
     def send_rom(self, rom):
         """Send rom."""
-        addr, data = rom.next_rom_data(0)
-        while data != None:
-            self.binary(addr, data)
-            addr += len(data)
-            addr, data = rom.next_rom_data(addr)
+        self.send_chunks(rom.chunks())
+
+    def send_chunks(self, chunks, pipeline=1):
+        """Send (addr, data) chunks with BINARY commands. Up to pipeline
+        commands are written ahead of their prompts so the UART doesn't sit
+        idle while the RIA stores each chunk. Only go past 1 if the monitor
+        keeps up; an error reply is still raised, but after the commands
+        already in flight."""
+        pending = 0
+        for addr, data in chunks:
+            if pending == pipeline:
+                self.wait_for_prompt("]")
+                pending -= 1
+            self.write_binary(addr, data)
+            pending += 1
+        while pending:
+            self.wait_for_prompt("]")
+            pending -= 1
 
     def wait_for_prompt(self, prompt, timeout=DEFAULT_TIMEOUT):
         """Wait for prompt."""
@@ -110,6 +135,385 @@ class Monitor:
                     raise TimeoutError()
 
 
+class FakeMonitor:
+    """Stands in for the RP6502 monitor on a local pty so run and upload
+    can be tried without hardware. Speaks the ] prompt protocol: BINARY
+    into its own RAM and XRAM, RESET, and UPLOAD into memory. A pty can't
+    carry a break, so a NUL byte stops the "6502" instead. Logs every
+    command it takes."""
+
+    def __init__(self):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.slave)  # no echo before a client configures it
+        self.name = os.ttyname(self.slave)
+        self.memory = bytearray(0x20000)
+        self.files = {}
+        self.upload_name = None
+        self.buffer = bytearray()
+        self.chunks = 0
+
+    def log(self, message):
+        print(f"[{os.path.basename(__file__)}] {message}", flush=True)
+
+    def serve(self):
+        """Answer commands until interrupted."""
+        while True:
+            self.buffer += os.read(self.master, 4096)
+            while self.step():
+                pass
+
+    def step(self):
+        """Handle one complete command from the buffer, if there is one."""
+        if self.buffer[0:1] == b"\0":
+            del self.buffer[0]
+            self.upload_name = None
+            self.log("Break")
+            self.reply("\r\n]")
+            return True
+        end = self.buffer.find(b"\r")
+        if end < 0:
+            return False
+        line = self.buffer[:end].decode("ascii", "replace").strip()
+        words = line.split()
+        if self.upload_name != None:
+            return self.upload_step(end, line, words)
+        if len(words) == 4 and words[0].upper() == "BINARY":
+            addr, length, crc = (int(w.lstrip("$"), 16) for w in words[1:])
+            data = self.buffer[end + 1 : end + 1 + length]
+            if len(data) < length:
+                return False
+            del self.buffer[: end + 1 + length]
+            if binascii.crc32(data) != crc:
+                self.reply("?CRC does not match\r\n]")
+                return True
+            self.memory[addr : addr + length] = data
+            self.chunks += 1
+            self.log(f"BINARY ${addr:04X} ${length:03X}")
+            self.reply("]")
+            return True
+        del self.buffer[: end + 1]
+        if len(words) == 0:
+            self.reply("\r\n]")
+        elif words[0].upper() == "RESET":
+            reset = self.memory[0xFFFC] | self.memory[0xFFFD] << 8
+            self.log(f"RESET to ${reset:04X} after {self.chunks} chunks")
+            self.chunks = 0
+            self.reply("\r\n")
+        elif len(words) == 2 and words[0].upper() == "UPLOAD":
+            self.upload_name = words[1]
+            self.files[self.upload_name] = bytearray()
+            self.reply("}")
+        else:
+            self.reply(f"?Unknown command {words[0]}\r\n]")
+        return True
+
+    def upload_step(self, end, line, words):
+        if line.upper() == "END":
+            del self.buffer[: end + 1]
+            file = self.files[self.upload_name]
+            self.log(f"UPLOAD {self.upload_name} {len(file)} bytes")
+            self.upload_name = None
+            self.reply("]")
+            return True
+        length, crc = (int(w.lstrip("$"), 16) for w in words)
+        data = self.buffer[end + 1 : end + 1 + length]
+        if len(data) < length:
+            return False
+        del self.buffer[: end + 1 + length]
+        if binascii.crc32(data) != crc:
+            self.upload_name = None
+            self.reply("?CRC does not match\r\n]")
+            return True
+        self.files[self.upload_name] += data
+        self.reply("}")
+        return True
+
+    def reply(self, str):
+        os.write(self.master, bytes(str, "ascii"))
+
+
+class Manifest:
+    """What the device's RAM holds: the ROM the last run sent it and the
+    CRC32 of each chunk, kept per device in the user's cache directory, so
+    the next run of the same ROM can send only the chunks that changed.
+    Sending anything else throws it away. Chunks overlapping writable
+    sections of the link map next to the ROM, and XRAM chunks, are always
+    sent again; the program may have changed them."""
+
+    # Output sections of an llvm-mos link map the program writes to
+    WRITABLE = (".data", ".zp", ".bss", ".noinit")
+
+    def __init__(self, rom_file, device):
+        self.file = Manifest.device_file(device)
+        self.map_file = os.path.splitext(rom_file)[0] + ".map"
+        self.rom = os.path.abspath(rom_file)
+        self.device = device
+        self.sent = set()
+        try:
+            with open(self.file, "r") as f:
+                manifest = json.load(f)
+            if manifest["device"] == device and manifest["rom"] == self.rom:
+                self.sent = {tuple(chunk) for chunk in manifest["chunks"]}
+        except (OSError, ValueError, KeyError, TypeError):
+            pass
+        self.writable = None
+        if os.path.exists(self.map_file):
+            self.writable = Manifest.writable_ranges(self.map_file)
+
+    @staticmethod
+    def device_file(device):
+        cache = os.environ.get("XDG_CACHE_HOME") or os.path.join(os.path.expanduser("~"), ".cache")
+        return os.path.join(cache, "rp6502", re.sub(r"[^\w.-]", "_", device) + ".manifest")
+
+    @staticmethod
+    def writable_ranges(map_file):
+        """(start, end) of the writable output sections in a link map."""
+        ranges = []
+        line_re = re.compile(r"^\s*([0-9a-fA-F]+)\s+[0-9a-fA-F]+\s+([0-9a-fA-F]+)\s+\d+ (\S.*)$")
+        with open(map_file, "r") as f:
+            for line in f:
+                match = line_re.match(line.rstrip("\r\n"))
+                if match and match.group(3).startswith(Manifest.WRITABLE):
+                    addr = int(match.group(1), 16)
+                    ranges.append((addr, addr + int(match.group(2), 16)))
+        return ranges
+
+    @staticmethod
+    def key(addr, data):
+        return (addr, len(data), binascii.crc32(data))
+
+    def changed(self, chunks):
+        """The chunks that need sending."""
+        result = []
+        for addr, data in chunks:
+            writable = addr >= 0x10000 or any(
+                addr < end and start < addr + len(data) for start, end in self.writable or []
+            )
+            if writable or Manifest.key(addr, data) not in self.sent:
+                result.append((addr, data))
+        return result
+
+    @staticmethod
+    def discard(device):
+        """Call before sending the device anything; a send that fails part
+        way leaves no manifest."""
+        file = Manifest.device_file(device)
+        if os.path.exists(file):
+            os.remove(file)
+
+    def save(self, chunks):
+        chunks = [list(Manifest.key(addr, data)) for addr, data in chunks]
+        os.makedirs(os.path.dirname(self.file), exist_ok=True)
+        with open(self.file, "w") as f:
+            json.dump({"device": self.device, "rom": self.rom, "chunks": chunks}, f)
+
+
+class LZ:
+    """Compressed ROM layout. The 6502 RAM data of a ROM is packed into one
+    LZ stream that sits below a small decompressor at STUB_ADDR. The reset
+    vector points at the decompressor, which unpacks every region in place
+    and then jumps to the program's own reset vector.
+
+    Stream: a region count, then per region its address (little endian)
+    and commands until a 0:
+      $01-$7F  that many literal bytes follow
+      $80-$BF  copy (cmd & $3F) + 3 bytes from distance - 1 in one byte
+      $C0-$FF  same with distance - 1 in two bytes, little endian
+    """
+
+    STUB_ADDR = 0xFE00
+    RAM_END = 0xFF00  # I/O and vectors above
+    SCRATCH_END = 0x0007  # zero page used by the stub
+    STACK = range(0x0100, 0x0200)
+    MIN_MATCH = 3
+    MAX_MATCH = 0x3F + MIN_MATCH
+    MAX_LITERALS = 0x7F
+    MAX_DISTANCE = 0x10000
+    MAX_REGIONS = 0x7F
+    CHAIN_DEPTH = 64
+
+    # Assembled from the listing alongside, for STUB_ADDR. SRC, DST, MATCH
+    # and COUNT are zero page $00, $02, $04 and $06.
+    STUB = bytes.fromhex(
+    "D8"      # start:    cld
+    "A2FF"    #           ldx #$FF
+    "9A"      #           txs
+    "A900"    #           lda #<payload     ; patched
+    "8500"    #           sta SRC
+    "A900"    #           lda #>payload     ; patched
+    "8501"    #           sta SRC+1
+    "207AFE"  #           jsr getbyte
+    "8506"    #           sta COUNT
+    "C606"    # region:   dec COUNT
+    "3062"    #           bmi done
+    "207AFE"  #           jsr getbyte       ; destination address
+    "8502"    #           sta DST
+    "207AFE"  #           jsr getbyte
+    "8503"    #           sta DST+1
+    "207AFE"  # command:  jsr getbyte
+    "AA"      #           tax
+    "F0EC"    #           beq region        ; 0: end of region
+    "3012"    #           bmi match
+    "207AFE"  # literal:  jsr getbyte       ; 1-127: literal bytes
+    "A000"    #           ldy #0
+    "9102"    #           sta (DST),y
+    "E602"    #           inc DST
+    "D002"    #           bne lit_next
+    "E603"    #           inc DST+1
+    "CA"      # lit_next: dex
+    "D0F0"    #           bne literal
+    "F0E6"    #           beq command
+    "207AFE"  # match:    jsr getbyte       ; distance - 1, low byte
+    "49FF"    #           eor #$FF
+    "8504"    #           sta MATCH
+    "A9FF"    #           lda #$FF
+    "E0C0"    #           cpx #$C0
+    "9005"    #           bcc short
+    "207AFE"  #           jsr getbyte       ; high byte
+    "49FF"    #           eor #$FF
+    "8505"    # short:    sta MATCH+1       ; MATCH = -distance
+    "18"      #           clc
+    "A504"    #           lda MATCH
+    "6502"    #           adc DST
+    "8504"    #           sta MATCH
+    "A505"    #           lda MATCH+1
+    "6503"    #           adc DST+1
+    "8505"    #           sta MATCH+1
+    "8A"      #           txa
+    "293F"    #           and #$3F
+    "18"      #           clc
+    "6903"    #           adc #3
+    "AA"      #           tax
+    "A000"    #           ldy #0
+    "B104"    # copy:     lda (MATCH),y
+    "9102"    #           sta (DST),y
+    "C8"      #           iny
+    "CA"      #           dex
+    "D0F8"    #           bne copy
+    "98"      #           tya
+    "18"      #           clc
+    "6502"    #           adc DST
+    "8502"    #           sta DST
+    "90AC"    #           bcc command
+    "E603"    #           inc DST+1
+    "B0A8"    #           bcs command
+    "4C0000"  # done:     jmp reset         ; patched
+    "A000"    # getbyte:  ldy #0
+    "B100"    #           lda (SRC),y
+    "E600"    #           inc SRC
+    "D002"    #           bne get_done
+    "E601"    #           inc SRC+1
+    "60"      # get_done: rts
+    )
+    STUB_PAYLOAD_LO = 0x05
+    STUB_PAYLOAD_HI = 0x09
+    STUB_RESET = 0x78
+
+    @staticmethod
+    def compress(data):
+        """Commands for one region, ending with 0."""
+        out = bytearray()
+        literals = bytearray()
+        chains = {}
+        length = len(data)
+
+        def longest_match(i):
+            best_len, best_dist = 0, 0
+            for j in reversed(chains.get(bytes(data[i : i + 3]), [])[-LZ.CHAIN_DEPTH :]):
+                dist = i - j
+                if dist > LZ.MAX_DISTANCE:
+                    break
+                n = 0
+                limit = min(LZ.MAX_MATCH, length - i)
+                while n < limit and data[j + n] == data[i + n]:
+                    n += 1
+                # A long distance costs a byte more than a short one
+                if n - (dist > 0x100) > best_len - (best_dist > 0x100):
+                    best_len, best_dist = n, dist
+            if best_len < LZ.MIN_MATCH + (best_dist > 0x100):
+                return 0, 0
+            return best_len, best_dist
+
+        def insert(i):
+            if i + 3 <= length:
+                chains.setdefault(bytes(data[i : i + 3]), []).append(i)
+
+        def flush_literals():
+            for i in range(0, len(literals), LZ.MAX_LITERALS):
+                run = literals[i : i + LZ.MAX_LITERALS]
+                out.append(len(run))
+                out.extend(run)
+            literals.clear()
+
+        i = 0
+        while i < length:
+            n, dist = longest_match(i)
+            # Lazy matching: a longer match one byte on wins
+            if n and i + 1 < length:
+                insert(i)
+                n2, _ = longest_match(i + 1)
+                chains[bytes(data[i : i + 3])].pop()
+                if n2 > n + 1:
+                    n = 0
+            if n:
+                flush_literals()
+                if dist > 0x100:
+                    out.extend((0xC0 | (n - LZ.MIN_MATCH), (dist - 1) & 0xFF, (dist - 1) >> 8))
+                else:
+                    out.extend((0x80 | (n - LZ.MIN_MATCH), dist - 1))
+                for k in range(n):
+                    insert(i + k)
+                i += n
+            else:
+                literals.append(data[i])
+                insert(i)
+                i += 1
+        flush_literals()
+        out.append(0)
+        return out
+
+    @staticmethod
+    def decompress(mem, src: int):
+        """Python reference of the stub: unpack the stream at src into mem,
+        64K of 6502 RAM, in the same order the 6502 reads and writes it.
+        Returns the regions as (addr, length)."""
+        stub = range(LZ.STUB_ADDR, LZ.STUB_ADDR + len(LZ.STUB))
+        regions = []
+
+        def get():
+            nonlocal src
+            value = mem[src]
+            src = (src + 1) & 0xFFFF
+            return value
+
+        def put(dst, value):
+            if dst in stub or dst < LZ.SCRATCH_END or dst in LZ.STACK:
+                raise MemoryError(f"Decompressing over the decompressor at ${dst:04X}")
+            mem[dst] = value
+
+        count = get()
+        for _ in range(count):
+            start = dst = get() | get() << 8
+            while True:
+                command = get()
+                if command == 0:
+                    break
+                if command < 0x80:
+                    for _ in range(command):
+                        put(dst, get())
+                        dst += 1
+                    continue
+                distance = get()
+                if command >= 0xC0:
+                    distance |= get() << 8
+                match = (dst - distance - 1) & 0xFFFF
+                for k in range((command & 0x3F) + LZ.MIN_MATCH):
+                    put(dst, mem[(match + k) & 0xFFFF])
+                    dst += 1
+            regions.append((start, dst - start))
+        return regions
+
+
 class ROM:
     """Virtual ROM aka The RP6502 ROM."""
 
@@ -236,6 +640,109 @@ class ROM:
         """Returns true if $FFFC and $FFFD have been set."""
         return self.alloc[0xFFFC] and self.alloc[0xFFFD]
 
+    def ram_regions(self):
+        """Contiguous runs of data in 6502 RAM, as (addr, length)."""
+        regions = []
+        addr = 0
+        while addr < LZ.RAM_END:
+            if self.alloc[addr]:
+                start = addr
+                while addr < LZ.RAM_END and self.alloc[addr]:
+                    addr += 1
+                regions.append((start, addr - start))
+            else:
+                addr += 1
+        return regions
+
+    def compressed(self):
+        """Returns this ROM with its 6502 RAM data LZ compressed behind the
+        decompress-on-reset stub. Raises if it doesn't round trip."""
+        if not self.has_reset_vector():
+            raise RuntimeError("Compressed ROMs need a reset vector")
+        regions = self.ram_regions()
+        if len(regions) > LZ.MAX_REGIONS:
+            raise RuntimeError(f"More than {LZ.MAX_REGIONS} regions to compress")
+        payload = bytearray([len(regions)])
+        for addr, length in regions:
+            payload.extend((addr & 0xFF, addr >> 8))
+            payload.extend(LZ.compress(self.data[addr : addr + length]))
+        payload_addr = LZ.STUB_ADDR - len(payload)
+        if payload_addr < 0x0200:
+            raise RuntimeError("Compressed data doesn't fit in RAM")
+
+        stub = bytearray(LZ.STUB)
+        stub[LZ.STUB_PAYLOAD_LO] = payload_addr & 0xFF
+        stub[LZ.STUB_PAYLOAD_HI] = payload_addr >> 8
+        stub[LZ.STUB_RESET] = self.data[0xFFFC]
+        stub[LZ.STUB_RESET + 1] = self.data[0xFFFD]
+
+        rom = ROM()
+        rom.help = list(self.help)
+        rom.add_binary_data(payload + stub, payload_addr)
+        rom.add_reset_vector(LZ.STUB_ADDR)
+        # I/O page, the other vectors and XRAM stay as they are
+        for addr in list(range(LZ.RAM_END, 0x10000)) + list(range(0x10000, 0x20000)):
+            if self.alloc[addr] and addr not in (0xFFFC, 0xFFFD):
+                rom.allocate_rom(addr, 1)
+                rom.data[addr] = self.data[addr]
+
+        rom.verify_against(self)
+        return rom
+
+    def decompressed(self):
+        """Returns the ROM a compressed ROM unpacks to on reset, using the
+        Python reference of the stub."""
+        stub_addr = self.data[0xFFFC] | self.data[0xFFFD] << 8
+        stub = bytearray(self.data[LZ.STUB_ADDR : LZ.STUB_ADDR + len(LZ.STUB)])
+        payload_addr = stub[LZ.STUB_PAYLOAD_LO] | stub[LZ.STUB_PAYLOAD_HI] << 8
+        reset = stub[LZ.STUB_RESET] | stub[LZ.STUB_RESET + 1] << 8
+        for i in (LZ.STUB_PAYLOAD_LO, LZ.STUB_PAYLOAD_HI, LZ.STUB_RESET, LZ.STUB_RESET + 1):
+            stub[i] = 0
+        if stub_addr != LZ.STUB_ADDR or stub != LZ.STUB:
+            raise RuntimeError("Not a compressed RP6502 ROM")
+
+        # RAM as the 6502 sees it at reset
+        mem = bytearray(0x10000)
+        for addr in range(0x10000):
+            if self.alloc[addr]:
+                mem[addr] = self.data[addr]
+        regions = LZ.decompress(mem, payload_addr)
+
+        rom = ROM()
+        rom.help = list(self.help)
+        for addr, length in regions:
+            rom.add_binary_data(mem[addr : addr + length], addr)
+        rom.add_reset_vector(reset)
+        for addr in list(range(LZ.RAM_END, 0x10000)) + list(range(0x10000, 0x20000)):
+            if self.alloc[addr] and addr not in (0xFFFC, 0xFFFD):
+                rom.allocate_rom(addr, 1)
+                rom.data[addr] = self.data[addr]
+        return rom
+
+    def is_compressed(self):
+        """True if reset goes to the decompress-on-reset stub."""
+        stub_addr = self.data[0xFFFC] | self.data[0xFFFD] << 8
+        return stub_addr == LZ.STUB_ADDR and self.alloc[LZ.STUB_ADDR]
+
+    def verify_against(self, original):
+        """Decompress this ROM and compare it byte for byte with original."""
+        rom = self.decompressed()
+        for addr in range(0x20000):
+            if rom.alloc[addr] != original.alloc[addr] or (
+                rom.alloc[addr] and rom.data[addr] != original.data[addr]
+            ):
+                raise RuntimeError(f"Compressed ROM differs at ${addr:04X}")
+
+    def chunks(self):
+        """All the data as (addr, data) chunks of up to 1k."""
+        chunks = []
+        addr, data = self.next_rom_data(0)
+        while data != None:
+            chunks.append((addr, data))
+            addr += len(data)
+            addr, data = self.next_rom_data(addr)
+        return chunks
+
     def next_rom_data(self, addr: int):
         """Find next up-to-1k chunk starting at addr."""
         for addr in range(addr, 0x20000):
@@ -266,10 +773,12 @@ def exec_args():
     )
     parser.add_argument(
         "command",
-        choices=["run", "upload", "create"],
+        choices=["run", "upload", "create", "verify", "fake"],
         help="Run local RP6502 ROM file by sending to RP6502 RAM. "
         "Upload any local files to RP6502 USB MSC drive. "
-        "Create RP6502 ROM file from a local binary file and additional local ROM files. ",
+        "Create RP6502 ROM file from a local binary file and additional local ROM files. "
+        "Verify a compressed RP6502 ROM file decompresses to a local ROM file. "
+        "Fake an RP6502 monitor on a local pty for trying run and upload. ",
     )
     parser.add_argument("filename", nargs="*", help="Local filename(s).")
     parser.add_argument("-o", dest="out", metavar="name", help="Output path/filename.")
@@ -302,6 +811,29 @@ def exec_args():
     parser.add_argument(
         "-r", "--reset", dest="reset", metavar="addr", help="Reset vector."
     )
+    parser.add_argument(
+        "-z",
+        "--compress",
+        dest="compress",
+        action="store_true",
+        help="Create a ROM that decompresses itself on reset.",
+    )
+    parser.add_argument(
+        "-d",
+        "--delta",
+        dest="delta",
+        action="store_true",
+        help="Run sends only the chunks that changed since the last run.",
+    )
+    parser.add_argument(
+        "-p",
+        "--pipeline",
+        dest="pipeline",
+        metavar="n",
+        type=int,
+        default=1,
+        help="BINARY commands run keeps in flight. Default=1",
+    )
     args = parser.parse_args()
 
     # Standard library configuration parser
@@ -337,20 +869,57 @@ def exec_args():
         rom.add_rp6502_file(args.filename[0])
         if args.reset != None:
             rom.add_reset_vector(args.reset)
+        chunks = rom.chunks()
+        manifest = Manifest(args.filename[0], args.device)
+        if args.delta:
+            if rom.is_compressed():
+                # The program overwrites the compressed payload as it runs
+                print(f"[{os.path.basename(__file__)}] Compressed ROM, sending all")
+            else:
+                if manifest.writable == None:
+                    print(f"[{os.path.basename(__file__)}] No {manifest.map_file}, "
+                          "changed initialized data won't be sent again")
+                chunks = manifest.changed(chunks)
         print(f"[{os.path.basename(__file__)}] Opening device {args.device}")
         mon = Monitor(args.device)
         mon.send_break()
-        mon.send_rom(rom)
+        Manifest.discard(args.device)
+        start = time.monotonic()
+        mon.send_chunks(chunks, args.pipeline)
+        if not rom.is_compressed():
+            # A compressed ROM's chunks are gone once it unpacks
+            manifest.save(rom.chunks())
+        print(
+            f"[{os.path.basename(__file__)}] Sent {len(chunks)} of {len(rom.chunks())} chunks, "
+            f"{sum(len(data) for addr, data in chunks)} bytes in {time.monotonic() - start:.2f}s"
+        )
         if rom.has_reset_vector():
             mon.reset()
         else:
             print("No reset vector. Not resetting.")
 
+    # python3 tools/rp6502.py fake
+    if args.command == "fake":
+        fake = FakeMonitor()
+        if args.out:
+            if os.path.lexists(args.out):
+                os.remove(args.out)
+            os.symlink(fake.name, args.out)
+        print(f"[{os.path.basename(__file__)}] Fake RP6502 on {args.out or fake.name}", flush=True)
+        try:
+            fake.serve()
+        except KeyboardInterrupt:
+            pass
+        finally:
+            if args.out and os.path.islink(args.out):
+                os.remove(args.out)
+
     # python3 tools/rp6502.py upload
     if args.command == "upload":
         print(f"[{os.path.basename(__file__)}] Opening device {args.device}")
         mon = Monitor(args.device)
         if len(args.filename) > 0:
+            Manifest.discard(args.device)
             mon.send_break()
         for file in args.filename:
             print(f"[{os.path.basename(__file__)}] Uploading {file}")
@@ -376,6 +945,10 @@ def exec_args():
         for file in args.filename[1:]:
             print(f"[{os.path.basename(__file__)}] Adding ROM Asset {file}")
             rom.add_rp6502_file(file)
+        if args.compress:
+            size = sum(rom.alloc)
+            rom = rom.compressed()
+            print(f"[{os.path.basename(__file__)}] Compressed {size} to {sum(rom.alloc)} bytes")
         with open(args.out, "wb+") as file:
             file.write(b"#!RP6502\n")
             for help in rom.help:
@@ -392,6 +965,20 @@ def exec_args():
                 addr += len(data)
                 addr, data = rom.next_rom_data(addr)
 
+    # python3 tools/rp6502.py verify
+    if args.command == "verify":
+        print(f"[{os.path.basename(__file__)}] Loading ROM {args.filename[0]}")
+        rom = ROM()
+        rom.add_rp6502_file(args.filename[0])
+        if len(args.filename) > 1:
+            print(f"[{os.path.basename(__file__)}] Comparing with ROM {args.filename[1]}")
+            original = ROM()
+            original.add_rp6502_file(args.filename[1])
+            rom.verify_against(original)
+        else:
+            rom.decompressed()
+        print(f"[{os.path.basename(__file__)}] OK")
+
 
 # This file may be included or run like a program. e.g.
 #   import importlib
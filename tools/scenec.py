@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: Unlicense
+
+# Scene compiler: turns a scene description (see scenes/default.json) into
+# C for the SCENE_COMPILED build of raytracer_float.c.
+#
+#   scene_data.h   the spheres[], boxes[] and lights[] arrays
+#   scene_trace.h  closest_object(), object_hit(), reflection_object() and
+#                  in_shadow() for this scene: every object's test unrolled
+#                  with its constants inlined, sphere normals scaled by a
+#                  constant 1/r, and the reflection and shadow lists worked
+#                  out here instead of at run time
+#
+#   python3 tools/scenec.py scenes/default.json -o build
+
+import os
+import sys
+import json
+import math
+import struct
+import argparse
+
+# Must match raytracer_float.c
+MAX_OBJECTS = 8
+MAX_LIGHTS = 4
+SHADOW_BOUNDS_SLACK = 0.01
+
+
+def f32(x):
+    """Round to the nearest float, as the 6502 build stores it."""
+    return struct.unpack("<f", struct.pack("<f", x))[0]
+
+
+def c_float(x):
+    """Shortest C float literal for x rounded to float."""
+    x = f32(x)
+    for digits in range(1, 10):
+        text = f"{x:.{digits}g}"
+        if f32(float(text)) == x:
+            break
+    if "e" in text and 1e-4 <= abs(x) < 1e9:
+        text = f"{float(text):f}".rstrip("0")
+    if text.endswith("."):
+        text += "0"
+    elif "." not in text and "e" not in text:
+        text += ".0"
+    return text + "f"
+
+
+def c_sub(expr, value):
+    """expr - value, folding the sign of the constant into the operator."""
+    value = f32(value)
+    if value == 0.0:
+        return expr
+    if value < 0.0:
+        return f"{expr} + {c_float(-value)}"
+    return f"{expr} - {c_float(value)}"
+
+
+def c_color(rgb):
+    return f"COLOR_FROM_RGB8({rgb[0]}, {rgb[1]}, {rgb[2]})"
+
+
+def c_bool(value):
+    return "true" if value else "false"
+
+
+def c_vector(v):
+    return "{" + ", ".join(c_float(c) for c in v) + "}"
+
+
+class SceneError(Exception):
+    pass
+
+
+def check_vector(item, key):
+    v = item.get(key)
+    if not isinstance(v, list) or len(v) != 3 or not all(isinstance(c, (int, float)) for c in v):
+        raise SceneError(f"{item.get('name', '?')}: {key} must be [x, y, z]")
+    return [float(c) for c in v]
+
+
+def check_color(item):
+    c = item.get("color")
+    if not isinstance(c, list) or len(c) != 3 or not all(isinstance(x, int) and 0 <= x <= 255 for x in c):
+        raise SceneError(f"{item.get('name', '?')}: color must be [r, g, b], 0-255")
+    return c
+
+
+def load_scene(file):
+    with open(file, "r") as f:
+        scene = json.load(f)
+    spheres, boxes, lights = [], [], []
+    for i, s in enumerate(scene.get("spheres", [])):
+        radius = s.get("radius")
+        if not isinstance(radius, (int, float)) or radius <= 0:
+            raise SceneError(f"{s.get('name', '?')}: radius must be > 0")
+        spheres.append({
+            "name": s.get("name", f"Sphere {i}"),
+            "center": check_vector(s, "center"),
+            "radius": float(radius),
+            "color": check_color(s),
+            "reflects": bool(s.get("reflects", False)),
+        })
+    for i, b in enumerate(scene.get("boxes", [])):
+        box = {
+            "name": b.get("name", f"Box {i}"),
+            "min": check_vector(b, "min"),
+            "max": check_vector(b, "max"),
+            "color": check_color(b),
+            "reflects": bool(b.get("reflects", False)),
+        }
+        if any(lo >= hi for lo, hi in zip(box["min"], box["max"])):
+            raise SceneError(f"{box['name']}: min must be below max on every axis")
+        boxes.append(box)
+    for i, l in enumerate(scene.get("lights", [])):
+        intensity = l.get("intensity")
+        if not isinstance(intensity, int) or not 0 <= intensity <= 255:
+            raise SceneError(f"{l.get('name', '?')}: intensity must be 0-255")
+        lights.append({
+            "name": l.get("name", f"Light {i}"),
+            "position": check_vector(l, "position"),
+            "intensity": intensity,
+            "directional": bool(l.get("directional", False)),
+        })
+    # The tracer sizes everything from these arrays, which C can't leave empty
+    if not spheres or not boxes:
+        raise SceneError("the scene needs at least one sphere and one box")
+    if len(spheres) + len(boxes) > MAX_OBJECTS:
+        raise SceneError(f"more than {MAX_OBJECTS} objects")
+    if not lights or len(lights) > MAX_LIGHTS:
+        raise SceneError(f"the scene needs 1 to {MAX_LIGHTS} lights")
+    return spheres, boxes, lights
+
+
+# Vector helpers for the shadow lists, in double precision
+def sub(a, b):
+    return [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+
+
+def dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+
+def scale(a, s):
+    return [a[0] * s, a[1] * s, a[2] * s]
+
+
+def object_bounds(spheres, boxes, o):
+    """Bounding sphere, as object_bounds() in raytracer_float.c."""
+    if o < len(spheres):
+        return spheres[o]["center"], spheres[o]["radius"] + SHADOW_BOUNDS_SLACK
+    box = boxes[o - len(spheres)]
+    half = scale(sub(box["max"], box["min"]), 0.5)
+    center = [box["min"][i] + half[i] for i in range(3)]
+    return center, math.sqrt(dot(half, half)) + SHADOW_BOUNDS_SLACK
+
+
+def may_occlude(light, oc, occR, rc, recR):
+    """Same conservative test as may_occlude() in raytracer_float.c."""
+    if light["directional"]:
+        p = light["position"]
+        d = scale(p, 1.0 / math.sqrt(dot(p, p)))
+        rel = sub(oc, rc)
+        along = dot(rel, d)
+        if along < -(occR + recR):
+            return False
+        perp = sub(rel, scale(d, along))
+        reach = occR + recR
+        return dot(perp, perp) < reach * reach
+
+    toOcc = sub(oc, light["position"])
+    toRec = sub(rc, light["position"])
+    dOcc = math.sqrt(dot(toOcc, toOcc))
+    dRec = math.sqrt(dot(toRec, toRec))
+    if dOcc <= occR or dRec <= recR:
+        return True
+    if dOcc - occR >= dRec + recR:
+        return False
+    n = scale(toOcc, -1.0 / dOcc)
+    if dot(sub(rc, oc), n) - occR >= recR:
+        return False
+    cosAxes = dot(toOcc, toRec) / (dOcc * dRec)
+    sinR, sinO = recR / dRec, occR / dOcc
+    cosSum = math.sqrt(1.0 - sinR * sinR) * math.sqrt(1.0 - sinO * sinO) - sinR * sinO
+    return cosAxes > cosSum
+
+
+def shadow_casters(spheres, boxes, light):
+    """Per receiving object, the objects that may block this light."""
+    count = len(spheres) + len(boxes)
+    casters = []
+    for r in range(count):
+        rc, recR = object_bounds(spheres, boxes, r)
+        casters.append([])
+        for o in range(count):
+            # Convex objects never shadow themselves
+            if o == r:
+                continue
+            oc, occR = object_bounds(spheres, boxes, o)
+            if may_occlude(light, oc, occR, rc, recR):
+                casters[r].append(o)
+    return casters
+
+
+def write_data(out, source, spheres, boxes, lights):
+    w = out.write
+    w(f"// Generated by tools/scenec.py from {source}. Do not edit.\n\n")
+    w("Sphere spheres[] = {\n")
+    for i, s in enumerate(spheres):
+        sep = "," if i < len(spheres) - 1 else ""
+        w(f"    {{{c_vector(s['center'])}, {c_float(s['radius'])}, {c_color(s['color'])}, {c_bool(s['reflects'])}}}{sep} // {s['name']}\n")
+    w("};\n")
+    w("const int sphereCount = sizeof(spheres) / sizeof(Sphere);\n\n")
+    w("Box boxes[] = {\n")
+    for i, b in enumerate(boxes):
+        sep = "," if i < len(boxes) - 1 else ""
+        w(f"    {{{c_vector(b['min'])}, {c_vector(b['max'])}, {c_color(b['color'])}, {c_bool(b['reflects'])}}}{sep} // {b['name']}\n")
+    w("};\n")
+    w("const int boxCount = sizeof(boxes) / sizeof(Box);\n\n")
+    w("Light lights[] = {\n")
+    for i, l in enumerate(lights):
+        sep = "," if i < len(lights) - 1 else ""
+        w(f"    {{{c_vector(l['position'])}, {l['intensity']}, {c_bool(l['directional'])}}}{sep} // {l['name']}\n")
+    w("};\n")
+    w("const int lightCount = sizeof(lights) / sizeof(Light);\n")
+
+
+def write_sphere_distance(w, i, s):
+    cx, cy, cz = s["center"]
+    r2 = f32(f32(s["radius"]) * f32(s["radius"]))
+    w(f"// {s['name']}\n")
+    w(f"static bool sphere{i}_distance(const Ray* ray, float* t) {{\n")
+    w("    STATS_INC(sphereTests);\n")
+    w(f"    float ox = {c_sub('ray->origin.x', cx)};\n")
+    w(f"    float oy = {c_sub('ray->origin.y', cy)};\n")
+    w(f"    float oz = {c_sub('ray->origin.z', cz)};\n")
+    w("    float a = ray->direction.x * ray->direction.x + ray->direction.y * ray->direction.y + ray->direction.z * ray->direction.z;\n")
+    w("    float b = ox * ray->direction.x + oy * ray->direction.y + oz * ray->direction.z;\n")
+    w(f"    float c = (ox * ox + oy * oy + oz * oz) - {c_float(r2)};\n")
+    w("    float discriminant = b * b - a * c;\n\n")
+    w("    // Near root without cancellation, see sphere_distance()\n")
+    w("    if (discriminant > 0 && b < 0) {\n")
+    w("        *t = c / (my_sqrtf(discriminant) - b);\n")
+    w("        return *t > 0;\n")
+    w("    }\n")
+    w("    return false;\n")
+    w("}\n\n")
+
+
+def write_box_distance(w, i, b):
+    lo, hi = b["min"], b["max"]
+    w(f"// {b['name']}\n")
+    w(f"static bool box{i}_distance(Ray* ray, float* t, uint8_t* axis) {{\n")
+    w("    STATS_INC(boxTests);\n")
+    w("    if (!ray->hasInverse) {\n")
+    w("        ray_inverse(ray);\n")
+    w("    }\n")
+    w("    uint8_t signs = ray->signs;\n")
+    w("    uint8_t entryAxis = 0;\n")
+    w("    uint8_t exitAxis = 0;\n\n")
+    for a, name, bit in ((0, "x", 1), (1, "y", 2), (2, "z", 4)):
+        near = "tmin" if a == 0 else f"t{name}min"
+        far = "tmax" if a == 0 else f"t{name}max"
+        w(f"    float {near} = (((signs & {bit}) ? {c_float(hi[a])} : {c_float(lo[a])}) - ray->origin.{name}) * ray->invDirection.{name};\n")
+        w(f"    float {far} = (((signs & {bit}) ? {c_float(lo[a])} : {c_float(hi[a])}) - ray->origin.{name}) * ray->invDirection.{name};\n\n")
+        if a > 0:
+            w(f"    if ((tmin > {far}) || ({near} > tmax)) return false;\n\n")
+            w(f"    if ({near} > tmin) {{ tmin = {near}; entryAxis = {a}; }}\n")
+            w(f"    if ({far} < tmax) {{ tmax = {far}; exitAxis = {a}; }}\n\n")
+    w("    if (tmax < 0.0f) return false; // Box is behind the ray\n\n")
+    w("    if (tmin < 0.0f) {\n")
+    w("        // Ray starts inside the box\n")
+    w("        *t = tmax;\n")
+    w("        *axis = exitAxis;\n")
+    w("    } else {\n")
+    w("        *t = tmin;\n")
+    w("        *axis = entryAxis;\n")
+    w("    }\n")
+    w("    return true;\n")
+    w("}\n\n")
+
+
+def c_test(spheres, o):
+    """Distance test of object o into tracer.t (and tracer.axis for boxes)."""
+    if o < len(spheres):
+        return f"sphere{o}_distance(ray, &tracer.t)"
+    return f"box{o - len(spheres)}_distance(ray, &tracer.t, &tracer.axis)"
+
+
+def object_name(spheres, boxes, o):
+    return spheres[o]["name"] if o < len(spheres) else boxes[o - len(spheres)]["name"]
+
+
+def write_trace(out, source, spheres, boxes, lights):
+    w = out.write
+    count = len(spheres) + len(boxes)
+    w(f"// Generated by tools/scenec.py from {source}. Do not edit.\n\n")
+
+    for i, s in enumerate(spheres):
+        write_sphere_distance(w, i, s)
+    for i, b in enumerate(boxes):
+        write_box_distance(w, i, b)
+
+    # Primary rays: spheres can use the scanline solve
+    w("static uint8_t closest_object(Ray* ray, uint8_t candidates, float* closestT, uint8_t* closestAxis) {\n")
+    w("    uint8_t closest = NO_OBJECT;\n\n")
+    for o in range(count):
+        w(f"    // {object_name(spheres, boxes, o)}\n")
+        if o < len(spheres):
+            w(f"    if ((candidates & 0x{1 << o:02X}) &&\n")
+            w(f"        (scanlineLength ? scanline_sphere_distance(ray, {o}, &tracer.t) : sphere{o}_distance(ray, &tracer.t)) &&\n")
+            w("        tracer.t < *closestT) {\n")
+            w("        *closestT = tracer.t;\n")
+        else:
+            w(f"    if ((candidates & 0x{1 << o:02X}) && {c_test(spheres, o)} && tracer.t < *closestT) {{\n")
+            w("        *closestT = tracer.t;\n")
+            w("        *closestAxis = tracer.axis;\n")
+        w(f"        closest = {o};\n")
+        w("    }\n")
+    w("    return closest;\n")
+    w("}\n\n")
+
+    w("static void object_hit(Ray* ray, uint8_t object, float t, uint8_t axis, HitInfo* hit) {\n")
+    w("    hit->t = t;\n")
+    w("    vec_madd(&hit->point, &ray->origin, &ray->direction, t);\n")
+    w("    hit->object = object;\n\n")
+    w("    switch (object) {\n")
+    for o, s in enumerate(spheres):
+        inv = f32(1.0 / f32(s["radius"]))
+        w(f"    case {o}: // {s['name']}\n")
+        for a, name in enumerate("xyz"):
+            normal = c_sub(f"hit->point.{name}", s["center"][a])
+            if inv != 1.0:
+                if normal != f"hit->point.{name}":
+                    normal = f"({normal})"
+                normal += f" * {c_float(inv)}"
+            w(f"        hit->normal.{name} = {normal};\n")
+        w(f"        hit->color = {c_color(s['color'])};\n")
+        w(f"        hit->reflects = {c_bool(s['reflects'])};\n")
+        w("        break;\n")
+    for i, b in enumerate(boxes):
+        w(f"    case {len(spheres) + i}: // {b['name']}\n")
+        w("    {\n")
+        w("        float facing = (ray->signs & (1 << axis)) ? 1.0f : -1.0f;\n")
+        w("        hit->normal = (Vector3){axis == 0 ? facing : 0.0f, axis == 1 ? facing : 0.0f, axis == 2 ? facing : 0.0f};\n")
+        w(f"        hit->color = {c_color(b['color'])};\n")
+        w(f"        hit->reflects = {c_bool(b['reflects'])};\n")
+        w("        break;\n")
+        w("    }\n")
+    w("    }\n")
+    w("}\n\n")
+
+    # Reflection rays test the spheres, except the one they leave: a ray
+    # can't go back into a convex object it starts on
+    w("static uint8_t reflection_object(Ray* ray, uint8_t object, float* closestT) {\n")
+    reflective = [o for o in range(count)
+                  if (spheres[o] if o < len(spheres) else boxes[o - len(spheres)])["reflects"]]
+    w("    uint8_t closest = NO_OBJECT;\n\n")
+    w("    switch (object) {\n")
+    for o in reflective:
+        w(f"    case {o}: // {object_name(spheres, boxes, o)}\n")
+        for i in range(len(spheres)):
+            if i == o:
+                continue
+            w(f"        if (sphere{i}_distance(ray, &tracer.t) && tracer.t < *closestT) {{\n")
+            w("            *closestT = tracer.t;\n")
+            w(f"            closest = {i};\n")
+            w("        }\n")
+        w("        break;\n")
+    w("    }\n")
+    w("    return closest;\n")
+    w("}\n\n")
+
+    # Shadow rays, per light and receiving object
+    casters = [shadow_casters(spheres, boxes, l) for l in lights]
+    w("static bool in_shadow(Ray* ray, uint8_t light, uint8_t object) {\n")
+    w("    switch (light * MAX_OBJECTS + object) {\n")
+    for l, light in enumerate(lights):
+        for r in range(count):
+            if not casters[l][r]:
+                continue
+            w(f"    case {l} * MAX_OBJECTS + {r}: // {light['name']} onto {object_name(spheres, boxes, r)}\n")
+            tests = [f"({c_test(spheres, o)} && tracer.t > 0.001f)" for o in casters[l][r]]
+            w("        return " + " ||\n               ".join(tests) + ";\n")
+    w("    }\n")
+    w("    return false;\n")
+    w("}\n")
+
+
+def exec_args():
+    parser = argparse.ArgumentParser(
+        description="Generate the SCENE_COMPILED scene code for raytracer_float.c."
+    )
+    parser.add_argument("scene", help="Scene description (JSON).")
+    parser.add_argument("-o", dest="out", metavar="dir", default=".",
+                        help="Output directory for scene_data.h and scene_trace.h.")
+    args = parser.parse_args()
+
+    try:
+        spheres, boxes, lights = load_scene(args.scene)
+    except (SceneError, ValueError) as e:
+        sys.exit(f"{args.scene}: {e}")
+
+    source = os.path.basename(args.scene)
+    with open(os.path.join(args.out, "scene_data.h"), "w") as out:
+        write_data(out, source, spheres, boxes, lights)
+    with open(os.path.join(args.out, "scene_trace.h"), "w") as out:
+        write_trace(out, source, spheres, boxes, lights)
+
+
+if __name__ == "__main__":
+    exec_args()